@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// monotonic memory for objects that die together, e.g. the nodes of the peptide dedup pool,
+// allocation bumps a pointer through large blocks, memory is only given back as a whole,
+// when the arena is destroyed or released, only the dedup benchmark compares against it
+class Arena {
+public:
+    explicit Arena(size_t block_size = 1 << 20) : block_size_(block_size) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment) {
+        auto address = Align(reinterpret_cast<uintptr_t>(cursor_), alignment);
+        if (cursor_ == nullptr || address + size > reinterpret_cast<uintptr_t>(end_)) {
+            return AllocateSlow(size, alignment);
+        }
+        cursor_ = reinterpret_cast<char*>(address + size);
+        return reinterpret_cast<void*>(address);
+    }
+
+    // small allocations stay until release, large ones (e.g. the bucket arrays left
+    // behind by a rehash) are given back at once
+    void Deallocate(void* pointer, size_t size, size_t alignment) {
+        if (!Large(size, alignment)) { return; }
+        for (auto i = large_blocks_.size(); i-- > 0;) {
+            auto address = reinterpret_cast<uintptr_t>(large_blocks_[i].get());
+            if (reinterpret_cast<void*>(Align(address, alignment)) == pointer) {
+                large_blocks_.erase(large_blocks_.begin() + i);
+                return;
+            }
+        }
+    }
+
+    // everything allocated so far is dropped, the first block is kept for reuse
+    void Release() {
+        large_blocks_.clear();
+        if (blocks_.empty()) { return; }
+        blocks_.resize(1);
+        cursor_ = blocks_.front().get();
+        end_ = cursor_ + block_size_;
+    }
+
+    size_t block_num() const { return blocks_.size() + large_blocks_.size(); }
+
+private:
+    const size_t block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<std::unique_ptr<char[]>> large_blocks_;
+    char* cursor_ = nullptr;
+    char* end_ = nullptr;
+
+    bool Large(size_t size, size_t alignment) const { return size + alignment > block_size_ / 4; }
+    static uintptr_t Align(uintptr_t address, size_t alignment) {
+        return (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    }
+
+    void* AllocateSlow(size_t size, size_t alignment) {
+        if (Large(size, alignment)) {  // large requests get a block of their own
+            large_blocks_.emplace_back(new char[size + alignment]);
+            return reinterpret_cast<void*>(Align(reinterpret_cast<uintptr_t>(large_blocks_.back().get()), alignment));
+        }
+        blocks_.emplace_back(new char[block_size_]);
+        cursor_ = blocks_.back().get();
+        end_ = cursor_ + block_size_;
+        return Allocate(size, alignment);
+    }
+};
+
+// std allocator over an arena
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena& arena) : arena_(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* pointer, size_t n) { arena_->Deallocate(pointer, n * sizeof(T), alignof(T)); }
+
+    Arena* arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+private:
+    Arena* arena_;
+};
@@ -0,0 +1,532 @@
+#define PPDATA_COUNT_ALLOCATIONS  // the build report counts the allocations of this program
+#include <AllocationCounter.h>
+#include <PPData.h>
+#include <ProtData.h>
+#include <PeptData.h>
+#include <PeptideSet.h>
+#include <Digester.h>
+#include <Hash.h>
+#include <SyntheticProteome.h>
+#include <FragGen.h>
+#include <MassTable.h>
+#include "Arena.h"
+#include <MgfReader.h>
+#include <Spectrum.h>
+#include <SearchDriver.h>
+#include <HyperScorer.h>
+#include <XcorrScorer.h>
+#include <MassCursor.h>
+#include <PrecursorQuery.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+#include <cstdlib>
+
+// command line: --filter=<substring of benchmark names> --proteins=<synthetic proteome size>
+// --trace=<file for the chrome trace of one build>
+static std::string benchmark_filter;
+static size_t proteome_size = 20000;
+static std::string trace_filename;
+static bool last_benchmark_ran = false;
+
+// run body repeatedly for at least half a second, report items processed per second
+template <typename Body>
+static void Benchmark(const char* name, const char* unit, Body&& body) {
+    last_benchmark_ran = std::strstr(name, benchmark_filter.c_str()) != nullptr;
+    if (!last_benchmark_ran) { return; }
+    using Clock = std::chrono::steady_clock;
+    size_t items = 0;
+    size_t iterations = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    do {
+        items += body();
+        ++iterations;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < 0.5);
+    std::printf("%-40s %10zu iterations %12.3f ms/iter %14.0f %s/s\n",
+                name, iterations, seconds * 1e3 / iterations, items / seconds, unit);
+}
+
+// extra line about the last benchmark, skipped along with it
+template <typename... Args>
+static void Note(const char* format, Args... args) {
+    if (last_benchmark_ran) { std::printf(format, args...); }
+}
+
+// a file in the temporary directory, removed when the benchmark is done with it
+class TempFile {
+public:
+    explicit TempFile(const std::string& name) : path_(Directory() + "/ppdata_bench_" + name) {}
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+    ~TempFile() { std::remove(path_.c_str()); }
+
+    operator const char*() const { return path_.c_str(); }
+
+private:
+    const std::string path_;
+
+    static std::string Directory() {
+        for (auto variable : { "TMPDIR", "TMP", "TEMP" }) {
+            auto directory = std::getenv(variable);
+            if (directory && *directory) { return directory; }
+        }
+#ifdef _WIN32
+        return ".";
+#else
+        return "/tmp";
+#endif
+    }
+};
+
+// random tryptic-like peptides over one backing protein
+struct RandomPeptides {
+    std::string sequence;
+    std::vector<PPData::Protein> proteins;
+    std::vector<PPData::Peptide> peptides;
+
+    RandomPeptides(size_t peptide_num, unsigned seed) {
+        const char residues[] = "ACDEFGHKLMNPQRSTVWY";
+        std::mt19937 engine(seed);
+        std::uniform_int_distribution<unsigned> length_dist(7, 30);
+        std::uniform_int_distribution<unsigned> residue_dist(0, sizeof(residues) - 2);
+        std::vector<size_t> lengths;
+        for (size_t i = 0; i < peptide_num; ++i) {
+            lengths.push_back(length_dist(engine));
+            for (size_t j = 0; j < lengths.back(); ++j) { sequence.push_back(residues[residue_dist(engine)]); }
+        }
+        proteins.push_back(PPData::Protein("synthetic", sequence.c_str(), sequence.size()));
+        size_t offset = 0;
+        for (auto length : lengths) {
+            peptides.push_back(PPData::Peptide(proteins.front(), sequence.c_str(), offset, offset + length, 0));
+            offset += length;
+        }
+    }
+};
+
+static void BenchFragmentGenerator() {
+    RandomPeptides set(100000, 1);
+    std::vector<double> ions(1024);
+    std::vector<double> prefix(1024);
+    double checksum = 0;
+
+    // reference: per-residue map lookups and scalar sums, as downstream scorers used to do
+    const std::unordered_map<char, double> mass_map = {
+        { 'G', 57.02147 },{ 'A', 71.03712 },{ 'S', 87.03203 },{ 'P', 97.05277 },
+        { 'V', 99.06842 },{ 'T', 101.04768 },{ 'C', 103.00919 + 57.021464 },{ 'L', 113.08407 },
+        { 'N', 114.04293 },{ 'D', 115.02695 },{ 'Q', 128.05858 },
+        { 'K', 128.09497 },{ 'E', 129.04260 },{ 'M', 131.04049 },{ 'H', 137.05891 },
+        { 'F', 147.06842 },{ 'R', 156.10112 },{ 'Y', 163.06333 },{ 'W', 186.07932 }
+    };
+    Benchmark("fragments/map_lookup b,y z<=2", "ions", [&]() {
+        size_t num = 0;
+        for (auto& peptide : set.peptides) {
+            for (unsigned charge = 1; charge <= 2; ++charge) {
+                double b = 0;
+                for (size_t i = 0; i + 1 < peptide.sequence_length; ++i) {
+                    b += mass_map.at(peptide.sequence[i]);
+                    ions[num % ions.size()] = (b + charge * MassTable::Proton()) / charge;
+                    ++num;
+                }
+                double y = MassTable::Water();
+                for (size_t i = 0; i + 1 < peptide.sequence_length; ++i) {
+                    y += mass_map.at(peptide.sequence[peptide.sequence_length - 1 - i]);
+                    ions[num % ions.size()] = (y + charge * MassTable::Proton()) / charge;
+                    ++num;
+                }
+            }
+        }
+        checksum += ions[0];
+        return num;
+    });
+
+    FragmentGenerator by(FragmentGenerator::kB | FragmentGenerator::kY, 2);
+    Benchmark("fragments/generator b,y z<=2", "ions", [&]() {
+        size_t num = 0;
+        for (auto& peptide : set.peptides) { num += by.Generate(peptide, ions.data(), prefix.data()); }
+        checksum += ions[0];
+        return num;
+    });
+
+    FragmentGenerator all(FragmentGenerator::kB | FragmentGenerator::kY | FragmentGenerator::kA
+                          | FragmentGenerator::kC | FragmentGenerator::kZ
+                          | FragmentGenerator::kWaterLoss | FragmentGenerator::kAmmoniaLoss, 3);
+    Benchmark("fragments/generator all z<=3", "ions", [&]() {
+        size_t num = 0;
+        for (auto& peptide : set.peptides) { num += all.Generate(peptide, ions.data(), prefix.data()); }
+        checksum += ions[0];
+        return num;
+    });
+    Note("(checksum %g)\n", checksum);
+}
+
+// spectra made of the b/y ladders of random peptides, charge 2
+static void WriteSyntheticMgf(const char* filename, const PPData& ppdata, size_t spectrum_num, unsigned seed) {
+    std::mt19937 engine(seed);
+    std::uniform_int_distribution<size_t> peptide_dist(0, ppdata.size() - 1);
+    FragmentGenerator generator;
+    std::vector<double> ions;
+    std::vector<double> prefix;
+    std::ofstream file(filename);
+    file.precision(10);
+    for (size_t i = 0; i < spectrum_num; ++i) {
+        auto& peptide = ppdata[peptide_dist(engine)];
+        generator.Generate(peptide, ions, prefix);
+        file << "BEGIN IONS\nTITLE=bench." << i << "\nPEPMASS=" << peptide.mass / 2 + MassTable::Proton()
+             << "\nCHARGE=2+\n";
+        for (size_t j = 0; j < ions.size(); ++j) { file << ions[j] << ' ' << 100 + j << '\n'; }
+        file << "END IONS\n";
+    }
+}
+
+// search one batch, serially and in parallel
+template <typename Scorer>
+static void BenchSearch(const char* name, const PPData& ppdata, const Scorer& scorer, double score_bin_width,
+                        const SpectrumBatch& batch) {
+    std::vector<std::vector<PSM>> results;
+    for (unsigned thread_num : { 1u, std::max(2u, std::thread::hardware_concurrency()) }) {
+        SearchDriver<Scorer> driver(ppdata, scorer, 0.05, 5, thread_num, score_bin_width);
+        SearchReport report;
+        auto label = std::string(name) + " x" + std::to_string(thread_num);
+        Benchmark(label.c_str(), "spectra", [&]() {
+            report = driver.Search(batch, results);
+            return report.spectrum_num;
+        });
+        Note("(%.0f candidates/s)\n", report.candidate_num / report.seconds);
+    }
+}
+
+static void BenchSpectrumPipeline() {
+    TempFile fasta("search.fasta");
+    TempFile mgf("search.mgf");
+    SyntheticProteome(5000, 2).Write(fasta);
+    PPData ppdata(fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    WriteSyntheticMgf(mgf, ppdata, 20000, 3);
+
+    SpectrumBatch batch;
+    Benchmark("mgf/read", "spectra", [&]() {
+        MgfReader reader(mgf);
+        size_t num = 0;
+        while (reader.NextBatch(batch, 1024) > 0) { num += batch.size(); }
+        return num;
+    });
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t candidates = 0;
+    Benchmark("mgf/read+lookup 0.05 Da", "spectra", [&]() {
+        MgfReader reader(mgf);
+        size_t num = 0;
+        while (reader.NextBatch(batch, 1024) > 0) {
+            PrecursorRanges(ppdata, batch, 0.05, ranges);
+            for (auto& range : ranges) { candidates += range.second - range.first; }
+            num += batch.size();
+        }
+        return num;
+    });
+    Note("(candidates %zu)\n", candidates);
+
+    // open search windows of spectra sorted by precursor mass
+    std::vector<double> masses;
+    {
+        MgfReader reader(mgf);
+        while (reader.NextBatch(batch, 1024) > 0) {
+            for (auto& spectrum : batch) { masses.push_back(spectrum.precursor_mass); }
+        }
+        std::sort(masses.begin(), masses.end());
+    }
+    size_t window_sum = 0;
+    Benchmark("window/binary_search -150..+500 Da", "windows", [&]() {
+        for (auto mass : masses) { window_sum += ppdata.upper_bound(mass + 150) - ppdata.lower_bound(mass - 500); }
+        return masses.size();
+    });
+    Benchmark("window/cursor -150..+500 Da", "windows", [&]() {
+        MassCursor cursor(ppdata);
+        for (auto mass : masses) { window_sum += cursor.Advance(mass - 500, mass + 150).size(); }
+        return masses.size();
+    });
+    Note("(window sum %zu)\n", window_sum);
+
+    // charges 2..4 and isotope errors -1..+3, as separate windows or merged
+    const std::vector<unsigned> charges = { 2, 3, 4 };
+    const std::vector<int> isotopes = { -1, 0, 1, 2, 3 };
+    std::vector<double> mzs;
+    for (auto mass : masses) { mzs.push_back(mass / 2 + MassTable::Proton()); }
+    size_t candidate_sum = 0;
+    for (double tolerance : { 20.0, 1000.0 }) {  // ppm, isotope windows overlap at the latter
+        auto label = " " + std::to_string(static_cast<int>(tolerance)) + " ppm";
+        Benchmark(("precursor/15 windows" + label).c_str(), "spectra", [&]() {
+            for (auto mz : mzs) {
+                for (auto charge : charges) {
+                    for (auto isotope : isotopes) {
+                        auto mass = (mz - MassTable::Proton()) * charge - isotope * PrecursorQuery::IsotopeSpacing();
+                        auto width = mass * tolerance * 1e-6;
+                        candidate_sum += ppdata.upper_bound(mass + width) - ppdata.lower_bound(mass - width);
+                    }
+                }
+            }
+            return mzs.size();
+        });
+        PrecursorQuery query(charges, isotopes, tolerance, true);
+        std::vector<PrecursorQuery::Range> query_ranges;
+        Benchmark(("precursor/merged query" + label).c_str(), "spectra", [&]() {
+            for (auto mz : mzs) {
+                query.Query(ppdata, mz, query_ranges);
+                for (auto& range : query_ranges) { candidate_sum += range.size(); }
+            }
+            return mzs.size();
+        });
+    }
+    Note("(candidate sum %zu)\n", candidate_sum);
+
+    MgfReader reader(mgf);
+    reader.NextBatch(batch, 2000);
+    BenchSearch("search/hyperscore 0.05 Da", ppdata, HyperScorer(), 0.1, batch);
+    BenchSearch("search/xcorr 0.05 Da", ppdata, XcorrScorer(), 0.01, batch);
+}
+
+// every build stage on its own, in the order PPData runs them, the input of each stage
+// is made once beforehand so that any of them can be selected alone
+struct DigestRecord {
+    size_t protein;
+    size_t start;
+    size_t end;
+    double mass;
+};
+
+static void DigestAll(const Digester& digester, const std::vector<PPData::Protein>& proteins,
+                      const std::vector<std::string>& compact, std::vector<DigestRecord>& digests) {
+    digests.clear();
+    for (size_t i = 0; i < proteins.size(); ++i) {
+        digester.Digest(compact[i].c_str(), proteins[i].sequence_length, [&](size_t start, size_t end, double mass) {
+            digests.push_back(DigestRecord{ i, start, end, mass });
+        });
+    }
+}
+
+using ArenaPeptidePool = std::unordered_set<PPData::Peptide, std::hash<PPData::Peptide>,
+                                             std::equal_to<PPData::Peptide>, ArenaAllocator<PPData::Peptide>>;
+
+static void Insert(std::unordered_set<PPData::Peptide>& pool, const PPData::Peptide& peptide) { pool.insert(peptide); }
+static void Insert(ArenaPeptidePool& pool, const PPData::Peptide& peptide) { pool.insert(peptide); }
+static void Insert(PeptideSet& pool, const PPData::Peptide& peptide) { pool.Insert(peptide); }
+
+template <typename Pool>
+static void DedupAll(const std::vector<PPData::Protein>& proteins, const std::vector<std::string>& compact,
+                     const std::vector<DigestRecord>& digests, Pool& pool) {
+    for (auto& digest : digests) {
+        Insert(pool, PPData::Peptide(proteins[digest.protein], compact[digest.protein].c_str(),
+                                     digest.start, digest.end, digest.mass));
+    }
+}
+
+static void SortByMass(std::vector<PPData::Peptide>& peptides) {
+    std::stable_sort(peptides.begin(), peptides.end(),
+                     [](const auto& one, const auto& another) { return one.mass < another.mass; });
+}
+
+static void BenchBuildStages() {
+    SyntheticProteome proteome(proteome_size, 1);
+    TempFile fasta("stages.fasta");
+    proteome.Write(fasta);
+    std::printf("(proteome: %zu proteins, %zu residues)\n", proteome.size(), proteome.residue_num());
+
+    auto raw_data = ProtData::ReadFile(fasta);
+    Benchmark("stage/read_file", "bytes", [&]() {
+        return ProtData::ReadFile(fasta).size();
+    });
+
+    std::vector<char> target_data;
+    ProtData::CompactFasta(raw_data, target_data);
+    Benchmark("stage/compact", "bytes", [&]() {
+        std::vector<char> data;
+        ProtData::CompactFasta(raw_data, data);
+        return raw_data.size();
+    });
+
+    std::vector<PPData::Protein> proteins;
+    ProtData::ParseProteins(target_data, proteins);
+    Benchmark("stage/protein_table", "proteins", [&]() {
+        std::vector<PPData::Protein> table;
+        ProtData::ParseProteins(target_data, table);
+        return table.size();
+    });
+
+    std::vector<char> decoy_data;
+    ProtData::BuildDecoys(proteins, target_data.size(), decoy_data);  // later stages run over both
+    Benchmark("stage/decoy", "proteins", [&]() {
+        std::vector<PPData::Protein> table(proteins.begin(), proteins.begin() + proteins.size() / 2);
+        std::vector<char> data;
+        ProtData::BuildDecoys(table, target_data.size(), data);
+        return table.size() / 2;
+    });
+
+    // compact sequences (I as L) as PeptData digests them
+    std::vector<std::string> compact;
+    for (auto& protein : proteins) {
+        compact.push_back(std::string(protein.sequence, protein.sequence_length));
+        for (auto& c : compact.back()) { c = Digester::Normalize(c); }
+    }
+    size_t residue_num = 0;
+    for (auto& protein : proteins) { residue_num += protein.sequence_length; }
+    std::vector<DigestRecord> digests;
+    size_t allocations = 0;
+    for (unsigned miss = 0; miss <= 5; ++miss) {
+        Digester miss_digester(PPData::EnzymeType::Trypsin, miss, 600, 5000);
+        DigestAll(miss_digester, proteins, compact, digests);
+        auto name = "stage/digest trypsin miss<=" + std::to_string(miss);
+        Benchmark(name.c_str(), "proteins", [&]() {
+            std::vector<DigestRecord> records;
+            records.reserve(digests.size());
+            auto before = AllocationCounter::count();
+            DigestAll(miss_digester, proteins, compact, records);
+            allocations = AllocationCounter::count() - before;
+            return proteins.size();
+        });
+        Note("(%zu peptides, %zu allocations per pass)\n", digests.size(), allocations);
+    }
+    Digester digester(PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    DigestAll(digester, proteins, compact, digests);  // the later stages run over miss<=2
+
+    // dedup tables, chained with a node per allocation, chained over an arena, and the
+    // open-addressing set PeptData builds with
+    std::unordered_set<PPData::Peptide> pool;
+    DedupAll(proteins, compact, digests, pool);
+    Benchmark("stage/dedup std::allocator", "peptides", [&]() {
+        auto before = AllocationCounter::count();
+        std::unordered_set<PPData::Peptide> local_pool;
+        DedupAll(proteins, compact, digests, local_pool);
+        allocations = AllocationCounter::count() - before;
+        return digests.size();
+    });
+    Note("(%zu digests, %zu distinct peptides, %zu allocations per pass)\n", digests.size(), pool.size(), allocations);
+    Benchmark("stage/dedup arena", "peptides", [&]() {
+        auto before = AllocationCounter::count();
+        Arena arena;
+        ArenaPeptidePool local_pool{ ArenaAllocator<PPData::Peptide>(arena) };
+        DedupAll(proteins, compact, digests, local_pool);
+        allocations = AllocationCounter::count() - before;
+        return digests.size();
+    });
+    Note("(%zu allocations per pass)\n", allocations);
+    Benchmark("stage/dedup flat set", "peptides", [&]() {
+        auto before = AllocationCounter::count();
+        PeptideSet local_pool(digester.EstimateDigestNum(residue_num, proteins.size()));
+        DedupAll(proteins, compact, digests, local_pool);
+        allocations = AllocationCounter::count() - before;
+        return digests.size();
+    });
+    Note("(%zu allocations per pass, estimate %zu for %zu digests)\n", allocations,
+         digester.EstimateDigestNum(residue_num, proteins.size()), digests.size());
+
+    std::vector<PPData::Peptide> peptides(pool.begin(), pool.end());
+    SortByMass(peptides);
+    Benchmark("stage/sort", "peptides", [&]() {
+        std::vector<PPData::Peptide> unsorted(pool.begin(), pool.end());
+        SortByMass(unsorted);
+        return unsorted.size();
+    });
+
+    std::vector<double> queries;
+    std::mt19937 engine(5);
+    std::uniform_real_distribution<double> mass_dist(600, 5000);
+    for (size_t i = 0; i < 100000; ++i) { queries.push_back(mass_dist(engine)); }
+    size_t range_sum = 0;
+    Benchmark("stage/range_query 0.05 Da", "queries", [&]() {
+        for (auto mass : queries) {
+            auto first = std::lower_bound(peptides.begin(), peptides.end(), mass - 0.05,
+                [](const auto& peptide, double value) { return peptide.mass < value; });
+            auto last = std::upper_bound(peptides.begin(), peptides.end(), mass + 0.05,
+                [](double value, const auto& peptide) { return value < peptide.mass; });
+            range_sum += last - first;
+        }
+        return queries.size();
+    });
+    Note("(range sum %zu)\n", range_sum);
+
+    PPData::Options options;
+    options.append_decoy = true;
+    options.max_miss_cleavage = 2;
+    for (auto thread_num : { 1u, std::max(2u, std::thread::hardware_concurrency()) }) {
+        options.thread_num = thread_num;
+        auto name = "build/ppdata threads=" + std::to_string(thread_num);
+        Benchmark(name.c_str(), "proteins", [&]() {
+            PPData ppdata(fasta, options);
+            return proteome.size();
+        });
+    }
+    options.thread_num = 1;
+    options.pack_sequences = true;
+    Benchmark("build/ppdata packed threads=1", "proteins", [&]() {
+        PPData ppdata(fasta, options);
+        return proteome.size();
+    });
+    if (last_benchmark_ran) {
+        PPData packed(fasta, options);
+        options.pack_sequences = false;
+        PPData plain(fasta, options);
+        Note("(sequence copy %zu KB, packed %zu KB)\n",
+             plain.build_report().stage("BuildCompactSequences")->buffer_bytes / 1024,
+             packed.build_report().stage("PackSequences")->buffer_bytes / 1024);
+    }
+    options.pack_sequences = false;
+    options.normalize_in_place = true;
+    Benchmark("build/ppdata normalize_in_place threads=1", "proteins", [&]() {
+        PPData ppdata(fasta, options);
+        return proteome.size();
+    });
+    options.normalize_in_place = false;
+    options.min_length = 7;
+    options.max_length = 50;
+    Benchmark("build/ppdata length=7-50 threads=1", "proteins", [&]() {
+        PPData ppdata(fasta, options);
+        return proteome.size();
+    });
+    options.min_length = 0;
+    options.max_length = 0;
+    options.additional_enzymes = { PPData::EnzymeType::GluC };
+    Benchmark("build/ppdata trypsin+gluc threads=1", "proteins", [&]() {
+        PPData ppdata(fasta, options);
+        return proteome.size();
+    });
+    options.additional_enzymes.clear();
+    if (!last_benchmark_ran) { return; }
+
+    // the build's own report of the same stages
+    PPData ppdata(fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    std::printf("  %-22s %10s %10s %12s %12s %12s %12s\n",
+                "stage", "wall ms", "cpu ms", "allocations", "buffer KB", "items in", "items out");
+    for (auto& stage : ppdata.build_report().stages) {
+        std::printf("  %-22s %10.2f %10.2f %12zu %12zu %12zu %12zu\n", stage.name.c_str(),
+                    stage.wall_seconds * 1e3, stage.cpu_seconds * 1e3, stage.allocations,
+                    stage.buffer_bytes / 1024, stage.items_in, stage.items_out);
+    }
+    if (!trace_filename.empty()) {
+        std::ofstream trace(trace_filename);
+        ppdata.build_report().WriteChromeTrace(trace);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--filter=", 9) == 0) { benchmark_filter = argv[i] + 9; }
+        else if (std::strncmp(argv[i], "--proteins=", 11) == 0) { proteome_size = std::strtoul(argv[i] + 11, nullptr, 10); }
+        else if (std::strncmp(argv[i], "--trace=", 8) == 0) { trace_filename = argv[i] + 8; }
+        else {
+            std::fprintf(stderr, "usage: %s [--filter=<name substring>] [--proteins=<number>] [--trace=<file>]\n", argv[0]);
+            return 1;
+        }
+    }
+    BenchBuildStages();
+    BenchFragmentGenerator();
+    BenchSpectrumPipeline();
+    return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// process-wide allocation counters read by the build report, they only move in programs
+// that replace the global operator new, which is done by defining PPDATA_COUNT_ALLOCATIONS
+// before including this header in exactly one translation unit (as the benchmark and the
+// unittest do), a library must not replace operator new behind its users' back
+class AllocationCounter {
+public:
+    static size_t count() { return Count().load(std::memory_order_relaxed); }
+    static size_t bytes() { return Bytes().load(std::memory_order_relaxed); }
+
+    static void Add(size_t size) {
+        Count().fetch_add(1, std::memory_order_relaxed);
+        Bytes().fetch_add(size, std::memory_order_relaxed);
+    }
+
+private:
+    static std::atomic<size_t>& Count() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+    static std::atomic<size_t>& Bytes() {
+        static std::atomic<size_t> bytes(0);
+        return bytes;
+    }
+};
+
+#ifdef PPDATA_COUNT_ALLOCATIONS
+// every replaceable form except the aligned ones, on top of malloc and free, the sized and
+// nothrow deletes forward to the plain ones as their default versions do, the plain ones
+// are kept out of line, since inlined at a delete expression GCC would pair free with the
+// operator new of the matching new expression and warn (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+#define PPDATA_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define PPDATA_NOINLINE __declspec(noinline)
+#else
+#define PPDATA_NOINLINE
+#endif
+
+inline void* CountedAllocate(size_t size) noexcept {
+    AllocationCounter::Add(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(size_t size) {
+    if (auto pointer = CountedAllocate(size)) { return pointer; }
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    if (auto pointer = CountedAllocate(size)) { return pointer; }
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAllocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAllocate(size); }
+
+PPDATA_NOINLINE void operator delete(void* pointer) noexcept { std::free(pointer); }
+PPDATA_NOINLINE void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { operator delete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { operator delete[](pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { operator delete(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { operator delete[](pointer); }
+
+#undef PPDATA_NOINLINE
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPDATA_BASE64_SSSE3
+#include <tmmintrin.h>
+#endif
+
+// base64 decoding for the binary arrays of mzML, blocks of 16 characters are decoded with
+// SSSE3 when the cpu has it (checked at run time), and the rest byte by byte, whitespace
+// is skipped and decoding stops at the first '=' or invalid character,
+// out must have room for 3 * length / 4 + 16 bytes, the number of bytes written is returned
+class Base64 {
+public:
+    static size_t Decode(const char* in, size_t length, uint8_t* out) {
+        size_t consumed = 0;
+        size_t written = 0;
+#ifdef PPDATA_BASE64_SSSE3
+        static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+        if (has_ssse3) { DecodeSsse3(in, length, out, consumed, written); }
+#endif
+        return written + DecodeScalar(in + consumed, length - consumed, out + written);
+    }
+
+private:
+    static size_t DecodeScalar(const char* in, size_t length, uint8_t* out) {
+        uint32_t accumulator = 0;
+        unsigned bits = 0;
+        size_t written = 0;
+        for (size_t i = 0; i < length; ++i) {
+            auto value = Value(in[i]);
+            if (value < 0) {
+                if (in[i] == ' ' || in[i] == '\n' || in[i] == '\r' || in[i] == '\t') { continue; }
+                break;  // padding or end of data
+            }
+            accumulator = accumulator << 6 | static_cast<uint32_t>(value);
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                out[written++] = static_cast<uint8_t>(accumulator >> bits);
+            }
+        }
+        return written;
+    }
+
+    static int Value(char c) {
+        if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+        if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+        if (c >= '0' && c <= '9') { return c - '0' + 52; }
+        if (c == '+') { return 62; }
+        if (c == '/') { return 63; }
+        return -1;
+    }
+
+#ifdef PPDATA_BASE64_SSSE3
+    // 16 characters to 12 bytes per step, classification and translation with pshufb lookups,
+    // stops before the first block holding anything but base64 alphabet
+    __attribute__((target("ssse3")))
+    static void DecodeSsse3(const char* in, size_t length, uint8_t* out, size_t& consumed, size_t& written) {
+        const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                             0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                             0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                               0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask_2f = _mm_set1_epi8(0x2F);
+        const __m128i pack_shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        while (consumed + 16 <= length) {
+            auto str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + consumed));
+            auto hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+            auto lo_nibbles = _mm_and_si128(str, mask_2f);
+            auto hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+            auto lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+            if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) { break; }
+
+            auto eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+            auto roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+            str = _mm_add_epi8(str, roll);  // 6-bit values
+
+            auto merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+            auto packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written), _mm_shuffle_epi8(packed, pack_shuffle));
+            consumed += 16;
+            written += 12;
+        }
+    }
+#endif
+};
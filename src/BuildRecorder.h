@@ -0,0 +1,62 @@
+#pragma once
+
+#include "PPData.h"
+#include "AllocationCounter.h"
+#include <chrono>
+#include <ctime>
+
+// fills a build report, one recorder per build, builders take a nullable pointer to it
+// so that they also run unrecorded (benchmarks, out-of-core builder)
+class BuildRecorder {
+public:
+    using BuildStage = PPData::BuildStage;
+    using Clock = std::chrono::steady_clock;
+
+    explicit BuildRecorder(PPData::BuildReport& report) : report_(report), origin_(Clock::now()) {}
+
+    // a point of the build, stages are the difference of two marks
+    struct Mark {
+        Clock::time_point wall;
+        std::clock_t cpu;
+        size_t allocations;
+        size_t bytes_allocated;
+    };
+
+    static Mark Now() {
+        return Mark{ Clock::now(), std::clock(), AllocationCounter::count(), AllocationCounter::bytes() };
+    }
+
+    BuildStage& Add(const char* name, const Mark& begin, const Mark& end,
+                    size_t items_in, size_t items_out, size_t buffer_bytes) {
+        report_.stages.push_back(BuildStage{ name, Seconds(begin.wall - origin_), Seconds(end.wall - begin.wall),
+                                             static_cast<double>(end.cpu - begin.cpu) / CLOCKS_PER_SEC,
+                                             end.allocations - begin.allocations,
+                                             end.bytes_allocated - begin.bytes_allocated,
+                                             buffer_bytes, items_in, items_out });
+        return report_.stages.back();
+    }
+
+private:
+    PPData::BuildReport& report_;
+    const Clock::time_point origin_;
+
+    static double Seconds(Clock::duration duration) { return std::chrono::duration<double>(duration).count(); }
+};
+
+// times one stage from construction to Stop, does nothing without a recorder
+class BuildStageTimer {
+public:
+    BuildStageTimer(BuildRecorder* recorder, const char* name)
+            : recorder_(recorder), name_(name) {
+        if (recorder_) { begin_ = BuildRecorder::Now(); }
+    }
+
+    void Stop(size_t items_in, size_t items_out, size_t buffer_bytes) {
+        if (recorder_) { recorder_->Add(name_, begin_, BuildRecorder::Now(), items_in, items_out, buffer_bytes); }
+    }
+
+private:
+    BuildRecorder* const recorder_;
+    const char* const name_;
+    BuildRecorder::Mark begin_;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Digester.h"
+#include "PeptTable.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+
+// what a build needs to be repeated incrementally, two independent 64-bit sequence hashes of
+// every protein and the peptides its digestion produced before deduplication across proteins,
+// in digest order
+class BuildState {
+public:
+    struct DigestRecord {
+        uint32_t offset;
+        uint32_t length;
+        double mass;
+    };
+    struct ProteinEntry {
+        uint64_t hash;
+        uint64_t check;  // second hash, a protein is only reused when both hashes match
+        uint32_t sequence_length;
+        uint32_t digest_num;
+        size_t digest_start;  // index of the first digest, not stored on disk
+    };
+
+    BuildState() = default;
+    explicit BuildState(const Digester& digester) {
+        std::memcpy(header_.magic, kMagic, sizeof(header_.magic));
+        header_.version = kVersion;
+        header_.enzyme_mask = digester.enzyme_mask();
+        header_.max_miss_cleavage = digester.max_miss_cleavage();
+        header_.min_mass = digester.min_mass();
+        header_.max_mass = digester.max_mass();
+        header_.min_length = digester.min_length();
+        header_.max_length = digester.max_length();
+    }
+
+    // a missing file gives an empty state, which matches no protein
+    static BuildState Load(const char* filename) {
+        BuildState state;
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) { return state; }
+        file.read(reinterpret_cast<char*>(&state.header_), sizeof(state.header_));
+        if (!file || std::memcmp(state.header_.magic, kMagic, sizeof(state.header_.magic)) != 0
+                || state.header_.version != kVersion) {
+            throw std::runtime_error("Not a build state file.");
+        }
+        state.proteins_.resize(static_cast<size_t>(state.header_.protein_num));
+        state.digests_.resize(static_cast<size_t>(state.header_.digest_num));
+        size_t digest_start = 0;
+        for (auto& entry : state.proteins_) {
+            file.read(reinterpret_cast<char*>(&entry.hash), sizeof(entry.hash));
+            file.read(reinterpret_cast<char*>(&entry.check), sizeof(entry.check));
+            file.read(reinterpret_cast<char*>(&entry.sequence_length), sizeof(entry.sequence_length));
+            file.read(reinterpret_cast<char*>(&entry.digest_num), sizeof(entry.digest_num));
+            entry.digest_start = digest_start;
+            digest_start += entry.digest_num;
+        }
+        file.read(reinterpret_cast<char*>(state.digests_.data()),
+                  static_cast<std::streamsize>(state.digests_.size() * sizeof(DigestRecord)));
+        if (!file || digest_start != state.digests_.size()) {
+            throw std::runtime_error("Build state file is truncated.");
+        }
+        return state;
+    }
+
+    void Save(const char* filename) const {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file) { throw std::runtime_error("Fail to create build state file."); }
+        file.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+        for (auto& entry : proteins_) {
+            file.write(reinterpret_cast<const char*>(&entry.hash), sizeof(entry.hash));
+            file.write(reinterpret_cast<const char*>(&entry.check), sizeof(entry.check));
+            file.write(reinterpret_cast<const char*>(&entry.sequence_length), sizeof(entry.sequence_length));
+            file.write(reinterpret_cast<const char*>(&entry.digest_num), sizeof(entry.digest_num));
+        }
+        file.write(reinterpret_cast<const char*>(digests_.data()),
+                   static_cast<std::streamsize>(digests_.size() * sizeof(DigestRecord)));
+        if (!file) { throw std::runtime_error("Fail to write build state file."); }
+    }
+
+    // digests can only be reused when they were produced by the same rules
+    bool Compatible(const Digester& digester) const {
+        return std::memcmp(header_.magic, kMagic, sizeof(header_.magic)) == 0
+               && header_.enzyme_mask == digester.enzyme_mask()
+               && header_.max_miss_cleavage == digester.max_miss_cleavage()
+               && header_.min_mass == digester.min_mass()
+               && header_.max_mass == digester.max_mass()
+               && header_.min_length == digester.min_length()
+               && header_.max_length == digester.max_length();
+    }
+
+    size_t size() const { return proteins_.size(); }
+    const ProteinEntry& operator[](const size_t index) const { return proteins_[index]; }
+    const DigestRecord* digests(const size_t index) const { return digests_.data() + proteins_[index].digest_start; }
+
+    // builders, digests are appended to the last added protein
+    void AddProtein(uint64_t hash, uint64_t check, size_t sequence_length) {
+        proteins_.push_back(ProteinEntry{ hash, check, static_cast<uint32_t>(sequence_length), 0, digests_.size() });
+        ++header_.protein_num;
+    }
+    void AddDigest(size_t start, size_t end, double mass) {
+        digests_.push_back(DigestRecord{ static_cast<uint32_t>(start), static_cast<uint32_t>(end - start), mass });
+        ++proteins_.back().digest_num;
+        ++header_.digest_num;
+    }
+
+    // statistics of the build that produced this state
+    size_t reused_protein_num() const { return reused_protein_num_; }
+    size_t digested_protein_num() const { return digested_protein_num_; }
+    void CountReused() { ++reused_protein_num_; }
+    void CountDigested() { ++digested_protein_num_; }
+
+    // FNV-1a over the protein sequence
+    static uint64_t Hash(const char* sequence, size_t sequence_length) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sequence_length; ++i) {
+            hash ^= static_cast<unsigned char>(sequence[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // multiply and xor-shift mix over the protein sequence, unrelated to Hash
+    static uint64_t Check(const char* sequence, size_t sequence_length) {
+        uint64_t check = 0x9e3779b97f4a7c15ull ^ sequence_length;
+        for (size_t i = 0; i < sequence_length; ++i) {
+            check = (check ^ static_cast<unsigned char>(sequence[i])) * 0xff51afd7ed558ccdull;
+            check ^= check >> 32;
+        }
+        return check;
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t enzyme_mask;
+        uint32_t max_miss_cleavage;
+        uint32_t reserved;
+        double min_mass;
+        double max_mass;
+        uint64_t min_length;
+        uint64_t max_length;
+        uint64_t protein_num;
+        uint64_t digest_num;
+    };
+
+    static constexpr const char* kMagic = "PPDSTATE";
+    enum : uint32_t { kVersion = 2 };
+
+    Header header_ = {};
+    std::vector<ProteinEntry> proteins_;
+    std::vector<DigestRecord> digests_;
+    size_t reused_protein_num_ = 0;
+    size_t digested_protein_num_ = 0;
+};
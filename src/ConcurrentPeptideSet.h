@@ -0,0 +1,82 @@
+#pragma once
+
+#include "PPData.h"
+#include "PeptideSet.h"
+#include <mutex>
+#include <memory>
+#include <vector>
+
+// dedup table many digestion threads insert into at once, the high bits of the peptide hash
+// select one of many shards, each an open-addressing PeptideSet behind its own lock, so two
+// threads only wait for each other when they hit the same shard, of equal peptides the one
+// of the earliest (protein, offset) is kept whatever the order of insertion, which is the
+// one a serial build digests first, Key hashes and compares peptides as in PeptideSet
+template <typename Key = SequenceKey>
+class BasicConcurrentPeptideSet {
+public:
+    using Peptide = PPData::Peptide;
+
+    // shards are at least 16 per thread, so that contention stays rare
+    BasicConcurrentPeptideSet(size_t expected_num, unsigned thread_num, const Key& key = Key()) : key_(key) {
+        unsigned bits = 1;
+        while ((1u << bits) < 16 * thread_num && bits < 12) { ++bits; }
+        shift_ = 32 - bits;
+        shard_num_ = size_t(1) << bits;
+        shards_.reset(new Shard[shard_num_]);
+        for (size_t i = 0; i < shard_num_; ++i) {
+            shards_[i].set.reset(new BasicPeptideSet<Key>(expected_num / shard_num_ + 1, key));
+        }
+    }
+
+    // thread-safe
+    void Insert(const Peptide& peptide) {
+        auto hash = key_.Hash(peptide);
+        auto& shard = shards_[hash >> shift_];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto result = shard.set->Emplace(peptide, hash);
+        if (!result.second && Earlier(peptide, (*shard.set)[result.first])) {
+            (*shard.set)[result.first] = peptide;
+        }
+    }
+
+    // no insertion may run concurrently with these
+    size_t size() const {
+        size_t size = 0;
+        for (size_t i = 0; i < shard_num_; ++i) { size += shards_[i].set->size(); }
+        return size;
+    }
+    size_t memory_bytes() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < shard_num_; ++i) { bytes += shards_[i].set->memory_bytes(); }
+        return bytes;
+    }
+
+    // the peptides shard by shard, the set is left empty
+    std::vector<Peptide> Release() {
+        std::vector<Peptide> peptides;
+        peptides.reserve(size());
+        for (size_t i = 0; i < shard_num_; ++i) {
+            auto shard_peptides = shards_[i].set->Release();
+            peptides.insert(peptides.end(), shard_peptides.begin(), shard_peptides.end());
+        }
+        return peptides;
+    }
+
+    // proteins are stored contiguously in database order
+    static bool Earlier(const Peptide& one, const Peptide& another) {
+        return one.protein < another.protein || (one.protein == another.protein && one.offset < another.offset);
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::unique_ptr<BasicPeptideSet<Key>> set;
+    };
+
+    const Key key_;
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_num_;
+    unsigned shift_;
+};
+
+using ConcurrentPeptideSet = BasicConcurrentPeptideSet<>;
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "PPData.h"
+#include "MassTable.h"
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+// bit (1 << EnzymeType) for each enzyme of a digestion
+inline uint32_t EnzymeMask(PPData::EnzymeType enzyme_type) {
+    return 1u << static_cast<unsigned>(enzyme_type);
+}
+
+// enzyme_type and additional_enzymes together
+inline uint32_t EnzymeMask(const PPData::Options& options) {
+    auto enzyme_mask = EnzymeMask(options.enzyme_type);
+    for (auto enzyme_type : options.additional_enzymes) { enzyme_mask |= EnzymeMask(enzyme_type); }
+    return enzyme_mask;
+}
+
+// enzymatic digestion rules, shared by the in-memory and the out-of-core builders
+class Digester {
+public:
+    using EnzymeType = PPData::EnzymeType;
+
+    // peptides are kept within [min_mass, max_mass] and [min_length, max_length] residues,
+    // max_length 0 for no limit
+    Digester(EnzymeType enzyme_type, unsigned max_miss_cleavage, double min_mass, double max_mass,
+             size_t min_length = 0, size_t max_length = 0)
+            : Digester(EnzymeMask(enzyme_type), max_miss_cleavage, min_mass, max_mass, min_length, max_length) {}
+
+    // several enzymes digesting together, their cleavage sites are all cut in one scan and
+    // missed cleavages are counted over all of them, a mixture or a sequential digest alike
+    Digester(uint32_t enzyme_mask, unsigned max_miss_cleavage, double min_mass, double max_mass,
+             size_t min_length = 0, size_t max_length = 0)
+            : enzyme_mask_(enzyme_mask), max_miss_cleavage_(max_miss_cleavage),
+              min_mass_(min_mass), max_mass_(max_mass), min_length_(min_length),
+              max_length_(max_length != 0 ? max_length : std::numeric_limits<size_t>::max()) {
+        if (enzyme_mask == 0) { throw std::runtime_error("Enzyme type is not supported."); }
+        for (auto& cleaves : cleaves_after_) { cleaves = false; }
+        for (unsigned type = 0; type < 32; ++type) {
+            if ((enzyme_mask & (1u << type)) && !AddCleavageRule(static_cast<EnzymeType>(type), cleaves_after_)) {
+                throw std::runtime_error("Enzyme type is not supported.");
+            }
+        }
+    }
+
+    uint32_t enzyme_mask() const { return enzyme_mask_; }
+    unsigned max_miss_cleavage() const { return max_miss_cleavage_; }
+    double min_mass() const { return min_mass_; }
+    double max_mass() const { return max_mass_; }
+    size_t min_length() const { return min_length_; }
+    size_t max_length() const { return max_length_; }
+
+    // rough number of peptides sink will see, for sizing tables up front, K and R make
+    // about one residue in nine and E one in fourteen, so tryptic segments average about
+    // nine residues, and the mass range drops about a fifth of the candidates
+    size_t EstimateDigestNum(size_t residue_num, size_t protein_num) const {
+        size_t sites_per_mille = (cleaves_after_['K'] ? 58 : 0) + (cleaves_after_['R'] ? 56 : 0)
+                                 + (cleaves_after_['E'] ? 71 : 0);
+        auto segment_num = residue_num * sites_per_mille / 1000 + protein_num;
+        return segment_num * (max_miss_cleavage_ + 1) * 4 / 5;
+    }
+
+    static char Normalize(char c) { return c == 'I' ? 'L' : c; }  // prefer L
+
+    // residues some supported enzyme cleaves after, a peptide is flanked by one of them on
+    // its n-terminal side and by the residue after one of them on its c-terminal side
+    static bool CleavesAfter(char c) {
+        static const CleavageSites any_enzyme = AnyEnzymeSites();
+        return any_enzyme.residues[static_cast<unsigned char>(c)];
+    }
+
+    // call sink(start, end, mass) for every peptide within the mass and length ranges,
+    // compact_sequence is expected to have I converted to L, filtered (if given) counts
+    // the candidates (a start and a number of missed cleavages) dropped for their mass, their
+    // length or an unknown residue, a peptide only grows with more missed cleavages, so the
+    // first one too long or too heavy (or with an unknown residue) ends those from its start,
+    // and all of them are counted, sink calls and filtered then add up to the candidates
+    template <typename Sink>
+    void Digest(const char* compact_sequence, size_t sequence_length, Sink&& sink,
+                size_t* filtered = nullptr) const {
+        auto& scratch = ThreadScratch();  // reused across proteins, so digestion does not allocate
+        auto& cleavage_sites = scratch.cleavage_sites;
+        auto& segments_mass = scratch.segments_mass;
+        GenCleavageSites(compact_sequence, sequence_length, cleavage_sites);
+        SegmentsMass(compact_sequence, sequence_length, cleavage_sites, segments_mass);  // if segment equals to 0, then we ignore it
+        auto segment_num = static_cast<unsigned>(cleavage_sites.size());
+
+        // peptides of one start extend the previous one by a segment, so the mass is a running
+        // sum, in the same order as summing the segments afresh, a segment with an unknown
+        // residue is in every longer peptide too, so it ends the start, and a start at one is
+        // skipped at once
+        for (unsigned index = 0; index < segment_num; ++index) {
+            auto start = cleavage_sites[index];
+            auto mass = water_;
+            auto last_segment = std::min(segment_num - 1, index + max_miss_cleavage_);
+            for (auto segment = index; segment <= last_segment; ++segment) {
+                auto end = segment + 1 < segment_num ? cleavage_sites[segment + 1] : sequence_length;
+                auto segment_mass = segments_mass[segment];
+                // the candidates of this start not looked at are dropped with this one
+                if (segment_mass == 0 /* contain intractable amino acid */ || end - start > max_length_) {
+                    if (filtered) { *filtered += last_segment - segment + 1; }
+                    break;
+                }
+                mass += segment_mass;
+                if (max_mass_ < mass) {
+                    if (filtered) { *filtered += last_segment - segment + 1; }
+                    break;
+                }
+                if (mass < min_mass_ || end - start < min_length_) {
+                    if (filtered) { ++*filtered; }
+                    continue;
+                }
+                sink(start, end, mass);
+            }
+        }
+    }
+
+private:
+    const uint32_t enzyme_mask_;
+    const unsigned max_miss_cleavage_;
+    const double min_mass_;
+    const double max_mass_;
+    const size_t min_length_;
+    const size_t max_length_;
+
+    const MassTable& mass_table_ = MassTable::Default();
+    const double water_ = MassTable::Water();
+    bool cleaves_after_[256];  // by residue, over all the enzymes
+
+    // mark the residues enzyme_type cleaves after, false if it is not supported
+    static bool AddCleavageRule(EnzymeType enzyme_type, bool* cleaves_after) {
+        switch (enzyme_type) {  // to support more enzymes, simply add different cleavage rules here
+        case EnzymeType::Trypsin:  // Trypsin KR, not before P
+            cleaves_after['K'] = cleaves_after['R'] = true;
+            return true;
+        case EnzymeType::LysC:  // Lys-C K, not before P
+            cleaves_after['K'] = true;
+            return true;
+        case EnzymeType::GluC:  // Glu-C E (bicarbonate buffer), not before P
+            cleaves_after['E'] = true;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // the rules of every supported enzyme together
+    struct CleavageSites {
+        bool residues[256];
+    };
+    static CleavageSites AnyEnzymeSites() {
+        CleavageSites sites = {};
+        for (unsigned type = 0; type < 32; ++type) { AddCleavageRule(static_cast<EnzymeType>(type), sites.residues); }
+        return sites;
+    }
+
+    // per-thread buffers of Digest, sinks must not digest again on the same thread
+    struct Scratch {
+        std::vector<unsigned> cleavage_sites;
+        std::vector<double> segments_mass;
+    };
+    static Scratch& ThreadScratch() {
+        static thread_local Scratch scratch;
+        return scratch;
+    }
+
+    void GenCleavageSites(const char* compact_sequence, size_t sequence_length,
+                          std::vector<unsigned>& cleavage_sites) const {
+        cleavage_sites.clear();
+        cleavage_sites.push_back(0);
+        for (unsigned index = 1; index < sequence_length; ++index) {
+            if (cleaves_after_[static_cast<unsigned char>(compact_sequence[index - 1])]
+                && compact_sequence[index] != 'P') {
+                cleavage_sites.push_back(index);
+            }
+        }
+    }
+
+    // return the mass value in each segment, so that we don't have to re-compute them
+    void SegmentsMass(const char* sequence, size_t sequence_length, const std::vector<unsigned>& cleavage_sites,
+                      std::vector<double>& segments_mass) const {
+        segments_mass.clear();
+        for (unsigned i = 0; i < cleavage_sites.size(); ++i) {
+            auto start = cleavage_sites[i];
+            auto end = i == cleavage_sites.size() - 1
+                       ? sequence_length
+                       : cleavage_sites[i + 1];
+            double segment = 0;
+            for (auto j = start; j < end; ++j) {
+                auto residue_mass = mass_table_[sequence[j]];
+                if (residue_mass == 0) {
+                    segment = 0;  // if there is an unknown residue, the segment equals to 0
+                    break;
+                }
+                segment += residue_mass;
+            }
+            segments_mass.push_back(segment);
+        }
+    }
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "PPData.h"
+#include "ProtData.h"
+#include "Digester.h"
+#include "PeptTable.h"
+#include <string>
+#include <vector>
+#include <queue>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+// out-of-core peptide table builder, proteins are digested in batches bounded by
+// memory_budget bytes, every batch is sorted and spilled to a run file, and the
+// runs are k-way merged with deduplication into the final mass-sorted table, peptides for
+// which filter (if given) is false are dropped before they are spilled, see PPData::Options
+class ExternalBuilder {
+public:
+    using Protein = PPData::Protein;
+    using Filter = std::function<bool(const char* sequence, size_t length, double mass)>;
+
+    ExternalBuilder(const ProtData& proteins, const Digester& digester, size_t memory_budget,
+                    Filter filter = nullptr)
+            : proteins_(proteins), digester_(digester), filter_(std::move(filter)),
+              batch_capacity_(std::max<size_t>(memory_budget / sizeof(PeptRecord), kMinBufferRecords)),
+              memory_budget_(memory_budget) {}
+
+    // return the number of peptides written into table_filename
+    size_t Build(const char* table_filename, bool append_decoy) {
+        RunFiles run_files(table_filename);  // removed however the build ends
+        std::vector<std::string> runs;
+        std::vector<PeptRecord> batch;
+        batch.reserve(batch_capacity_);
+        std::vector<char> compact_sequence;  // reused scratch for the I/L conversion
+
+        for (uint32_t protein_index = 0; protein_index < proteins_.size(); ++protein_index) {
+            auto& protein = proteins_[protein_index];
+            auto sequence = protein.sequence;
+            if (!proteins_.normalized()) {
+                compact_sequence.resize(protein.sequence_length);
+                for (unsigned i = 0; i < protein.sequence_length; ++i) {
+                    compact_sequence[i] = Digester::Normalize(protein.sequence[i]);
+                }
+                sequence = compact_sequence.data();
+            }
+            digester_.Digest(sequence, protein.sequence_length,
+                [&](size_t start, size_t end, double mass) {
+                    if (filter_ && !filter_(sequence + start, end - start, mass)) { return; }
+                    batch.push_back(PeptRecord{ protein_index, static_cast<uint32_t>(start),
+                                                static_cast<uint32_t>(end - start), 0, mass });
+                }
+            );
+            if (batch.size() >= batch_capacity_) {
+                runs.push_back(SpillRun(batch, run_files.Add()));
+            }
+        }
+        if (!batch.empty() || runs.empty()) {
+            runs.push_back(SpillRun(batch, run_files.Add()));
+        }
+        std::vector<PeptRecord>().swap(batch);  // give the batch memory back before merging
+
+        // reduce the number of runs until they can be merged in one pass
+        while (runs.size() > kMaxFanIn) {
+            std::vector<std::string> merged_runs;
+            for (size_t i = 0; i < runs.size(); i += kMaxFanIn) {
+                std::vector<std::string> group(runs.begin() + i,
+                                               runs.begin() + std::min(i + kMaxFanIn, runs.size()));
+                auto merged_run = run_files.Add();
+                std::ofstream file(merged_run, std::ios::binary | std::ios::trunc);
+                if (!file) { throw std::runtime_error("Fail to create run file."); }
+                MergeRuns(group, [&](const PeptRecord& record) {
+                    file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+                });
+                merged_runs.push_back(merged_run);
+            }
+            runs.swap(merged_runs);
+        }
+
+        PeptTableHeader header = {};
+        header.enzyme_mask = digester_.enzyme_mask();
+        header.max_miss_cleavage = digester_.max_miss_cleavage();
+        header.append_decoy = append_decoy ? 1 : 0;
+        header.min_mass = digester_.min_mass();
+        header.max_mass = digester_.max_mass();
+        header.min_length = digester_.min_length();
+        header.max_length = digester_.max_length();
+        header.protein_num = proteins_.size();
+        PeptTableWriter writer(table_filename, header);
+        // the merge brings the peptides of equal mass together, they are written in the order
+        // of an in-memory build, so that an index means the same peptide in both
+        std::vector<PeptRecord> same_mass;
+        auto write_same_mass = [&]() {
+            std::sort(same_mass.begin(), same_mass.end(), [](const auto& one, const auto& another) {
+                if (one.protein != another.protein) { return one.protein < another.protein; }
+                if (one.offset != another.offset) { return one.offset < another.offset; }
+                return one.length < another.length;
+            });
+            for (auto& record : same_mass) { writer.Write(record); }
+            same_mass.clear();
+        };
+        MergeRuns(runs, [&](const PeptRecord& record) {
+            if (!same_mass.empty() && same_mass.front().mass != record.mass) { write_same_mass(); }
+            same_mass.push_back(record);
+        });
+        write_same_mass();
+        return static_cast<size_t>(writer.Close());
+    }
+
+private:
+    const ProtData& proteins_;
+    const Digester& digester_;
+    const Filter filter_;  // empty for none
+    const size_t batch_capacity_;
+    const size_t memory_budget_;
+
+    enum : size_t { kMinBufferRecords = 256, kMaxFanIn = 64 };  // records per buffer, runs per merge
+
+    // names of the run files next to the table, every one of them is removed on destruction,
+    // also when the build throws
+    class RunFiles {
+    public:
+        explicit RunFiles(const char* table_filename) : table_filename_(table_filename) {}
+        RunFiles(const RunFiles&) = delete;
+        RunFiles& operator=(const RunFiles&) = delete;
+        ~RunFiles() {
+            for (auto& name : names_) { std::remove(name.c_str()); }
+        }
+
+        // name of a new run file
+        const std::string& Add() {
+            names_.push_back(table_filename_ + ".run" + std::to_string(names_.size()));
+            return names_.back();
+        }
+
+    private:
+        const std::string table_filename_;
+        std::vector<std::string> names_;
+    };
+
+    // compare the I/L normalized sequences of two records
+    int CompareSequence(const PeptRecord& one, const PeptRecord& another) const {
+        const char* one_sequence = proteins_[one.protein].sequence + one.offset;
+        const char* another_sequence = proteins_[another.protein].sequence + another.offset;
+        auto length = std::min(one.length, another.length);
+        for (uint32_t i = 0; i < length; ++i) {
+            auto a = Digester::Normalize(one_sequence[i]);
+            auto b = Digester::Normalize(another_sequence[i]);
+            if (a != b) { return a < b ? -1 : 1; }
+        }
+        return one.length == another.length ? 0 : (one.length < another.length ? -1 : 1);
+    }
+
+    // order by mass, then sequence, then position, so that duplicates are adjacent and the
+    // first one of them comes from the earliest protein, which is the one kept in memory builds
+    bool Less(const PeptRecord& one, const PeptRecord& another) const {
+        if (one.mass != another.mass) { return one.mass < another.mass; }
+        auto order = CompareSequence(one, another);
+        if (order != 0) { return order < 0; }
+        if (one.protein != another.protein) { return one.protein < another.protein; }
+        return one.offset < another.offset;
+    }
+
+    bool SamePeptide(const PeptRecord& one, const PeptRecord& another) const {
+        return one.mass == another.mass && CompareSequence(one, another) == 0;
+    }
+
+    std::string SpillRun(std::vector<PeptRecord>& batch, const std::string& run) const {
+        std::sort(batch.begin(), batch.end(),
+                  [this](const auto& one, const auto& another) { return Less(one, another); });
+        batch.erase(std::unique(batch.begin(), batch.end(),
+                                [this](const auto& one, const auto& another) { return SamePeptide(one, another); }),
+                    batch.end());
+
+        std::ofstream file(run, std::ios::binary | std::ios::trunc);
+        if (!file) { throw std::runtime_error("Fail to create run file."); }
+        file.write(reinterpret_cast<const char*>(batch.data()),
+                   static_cast<std::streamsize>(batch.size() * sizeof(PeptRecord)));
+        if (!file) { throw std::runtime_error("Fail to write run file."); }
+        batch.clear();
+        return run;
+    }
+
+    // buffered sequential reader of one run file
+    class RunReader {
+    public:
+        RunReader(const std::string& filename, size_t buffer_records)
+                : file_(filename, std::ios::binary), buffer_(buffer_records) {
+            if (!file_) { throw std::runtime_error("Fail to open run file."); }
+        }
+
+        bool Next(PeptRecord& record) {
+            if (index_ == count_) {
+                file_.read(reinterpret_cast<char*>(buffer_.data()),
+                           static_cast<std::streamsize>(buffer_.size() * sizeof(PeptRecord)));
+                count_ = static_cast<size_t>(file_.gcount()) / sizeof(PeptRecord);
+                index_ = 0;
+                if (count_ == 0) { return false; }
+            }
+            record = buffer_[index_++];
+            return true;
+        }
+
+    private:
+        std::ifstream file_;
+        std::vector<PeptRecord> buffer_;
+        size_t index_ = 0;
+        size_t count_ = 0;
+    };
+
+    // k-way merge of sorted runs, emitting the first record of every distinct peptide,
+    // the input run files are removed afterwards
+    template <typename Emit>
+    void MergeRuns(const std::vector<std::string>& runs, Emit&& emit) const {
+        auto buffer_records = std::max<size_t>(memory_budget_ / (runs.size() + 1) / sizeof(PeptRecord),
+                                               kMinBufferRecords);
+        std::vector<RunReader> readers;
+        readers.reserve(runs.size());
+        for (auto& run : runs) { readers.emplace_back(run, buffer_records); }
+
+        using Head = std::pair<PeptRecord, size_t>;  // record and the reader it comes from
+        auto greater = [this](const Head& one, const Head& another) { return Less(another.first, one.first); };
+        std::priority_queue<Head, std::vector<Head>, decltype(greater)> heap(greater);
+        for (size_t i = 0; i < readers.size(); ++i) {
+            PeptRecord record;
+            if (readers[i].Next(record)) { heap.push(Head(record, i)); }
+        }
+
+        bool has_last = false;
+        PeptRecord last = {};
+        while (!heap.empty()) {
+            auto head = heap.top();
+            heap.pop();
+            if (!has_last || !SamePeptide(last, head.first)) {
+                emit(head.first);
+                last = head.first;
+                has_last = true;
+            }
+            PeptRecord record;
+            if (readers[head.second].Next(record)) { heap.push(Head(record, head.second)); }
+        }
+
+        readers.clear();
+        for (auto& run : runs) { std::remove(run.c_str()); }
+    }
+};
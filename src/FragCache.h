@@ -0,0 +1,174 @@
+#pragma once
+
+#include "PPData.h"
+#include "FragGen.h"
+#include <cstdint>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+// bounded cache of fragment ladders keyed by peptide index, so popular peptides scored
+// against many spectra are generated once, the cache is split into shards with their own
+// lock, each shard carves fixed-size slabs out of its byte budget and hands them to slot
+// size classes on demand (memcached style), and evicts with CLOCK within a size class
+class FragmentCache {
+public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t bypasses = 0;  // misses that could not be cached for lack of memory
+        size_t bytes = 0;  // slab memory in use
+
+        double hit_rate() const { return hits + misses == 0 ? 0 : double(hits) / (hits + misses); }
+    };
+
+    FragmentCache(const PPData& ppdata, const FragmentGenerator& generator,
+                  size_t byte_budget, unsigned shard_num = 16)
+            : ppdata_(ppdata), generator_(generator) {
+        shard_num = std::max(1u, shard_num);
+        for (unsigned i = 0; i < shard_num; ++i) {
+            shards_.push_back(std::unique_ptr<Shard>(new Shard(byte_budget / shard_num)));
+        }
+    }
+
+    // call visit(ions, ion_num) with the fragment ladder of peptide index, the shard stays
+    // locked during the call, so the ions must not be kept after it returns
+    template <typename Visitor>
+    void Visit(size_t index, Visitor&& visit) {
+        auto& shard = *shards_[ShardOf(index)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto peptide = ppdata_.peptide(index);
+        auto ion_num = generator_.IonNum(peptide.sequence_length);
+        if (shard.prefix.size() < peptide.sequence_length) { shard.prefix.resize(peptide.sequence_length); }
+
+        auto found = shard.map.find(index);
+        if (found != shard.map.end()) {
+            auto& slot = shard.classes[ClassOf(found->second)].slots[SlotOf(found->second)];
+            slot.referenced = true;
+            ++shard.stats.hits;
+            visit(static_cast<const double*>(slot.data), ion_num);
+            return;
+        }
+
+        ++shard.stats.misses;
+        auto slot = Allocate(shard, index, ion_num);
+        if (slot == nullptr) {  // too large or out of memory, generate without caching
+            ++shard.stats.bypasses;
+            shard.bypass.resize(ion_num);
+            generator_.Generate(peptide, shard.bypass.data(), shard.prefix.data());
+            visit(static_cast<const double*>(shard.bypass.data()), ion_num);
+            return;
+        }
+        generator_.Generate(peptide, slot->data, shard.prefix.data());
+        visit(static_cast<const double*>(slot->data), ion_num);
+    }
+
+    // copy the fragment ladder of peptide index into ions
+    size_t Get(size_t index, std::vector<double>& ions) {
+        Visit(index, [&](const double* data, size_t num) { ions.assign(data, data + num); });
+        return ions.size();
+    }
+
+    Stats stats() const {
+        Stats total;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total.hits += shard->stats.hits;
+            total.misses += shard->stats.misses;
+            total.evictions += shard->stats.evictions;
+            total.bypasses += shard->stats.bypasses;
+            total.bytes += shard->bytes;
+        }
+        return total;
+    }
+
+private:
+    enum : size_t {
+        kMinSlotDoubles = 16,  // size class k holds kMinSlotDoubles << k doubles
+        kClassNum = 10,
+        kSlabBytes = 64 * 1024,
+    };
+
+    struct Slot {
+        double* data;
+        size_t key;
+        bool referenced;
+    };
+    struct SizeClass {
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
+        size_t hand = 0;  // CLOCK hand
+    };
+    struct Shard {
+        explicit Shard(size_t budget) : budget(budget), classes(kClassNum) {}
+
+        mutable std::mutex mutex;
+        const size_t budget;
+        size_t bytes = 0;
+        std::vector<std::unique_ptr<double[]>> slabs;
+        std::vector<SizeClass> classes;
+        std::unordered_map<size_t, uint32_t> map;  // peptide index to class and slot handle
+        std::vector<double> prefix;  // generator scratch
+        std::vector<double> bypass;  // ladders that are not cached
+        Stats stats;
+    };
+
+    const PPData& ppdata_;
+    const FragmentGenerator& generator_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    size_t ShardOf(size_t index) const {
+        return static_cast<size_t>((static_cast<uint64_t>(index) * 0x9E3779B97F4A7C15ull) >> 32) % shards_.size();
+    }
+    static uint32_t Handle(size_t size_class, size_t slot) { return static_cast<uint32_t>(size_class << 24 | slot); }
+    static size_t ClassOf(uint32_t handle) { return handle >> 24; }
+    static size_t SlotOf(uint32_t handle) { return handle & 0xFFFFFF; }
+
+    // slot for key, from the free list, a new slab, or by evicting, nullptr when impossible
+    Slot* Allocate(Shard& shard, size_t key, size_t ion_num) {
+        size_t size_class = 0;
+        while (size_class < kClassNum && (kMinSlotDoubles << size_class) < ion_num) { ++size_class; }
+        if (size_class == kClassNum) { return nullptr; }
+        auto& klass = shard.classes[size_class];
+        auto slot_doubles = kMinSlotDoubles << size_class;
+
+        if (klass.free_slots.empty()) {
+            auto slab_doubles = std::max<size_t>(kSlabBytes / sizeof(double), slot_doubles);
+            if (shard.bytes + slab_doubles * sizeof(double) <= shard.budget
+                    && klass.slots.size() + slab_doubles / slot_doubles <= 0xFFFFFF) {
+                shard.slabs.push_back(std::unique_ptr<double[]>(new double[slab_doubles]));
+                shard.bytes += slab_doubles * sizeof(double);
+                auto slab = shard.slabs.back().get();
+                for (size_t i = 0; i + slot_doubles <= slab_doubles; i += slot_doubles) {
+                    klass.free_slots.push_back(static_cast<uint32_t>(klass.slots.size()));
+                    klass.slots.push_back(Slot{ slab + i, 0, false });
+                }
+            }
+            else if (!klass.slots.empty()) {  // CLOCK, referenced slots get a second chance
+                while (klass.slots[klass.hand].referenced) {
+                    klass.slots[klass.hand].referenced = false;
+                    klass.hand = (klass.hand + 1) % klass.slots.size();
+                }
+                auto& victim = klass.slots[klass.hand];
+                shard.map.erase(victim.key);
+                klass.free_slots.push_back(static_cast<uint32_t>(klass.hand));
+                klass.hand = (klass.hand + 1) % klass.slots.size();
+                ++shard.stats.evictions;
+            }
+            else {
+                return nullptr;
+            }
+        }
+
+        auto index = klass.free_slots.back();
+        klass.free_slots.pop_back();
+        auto& slot = klass.slots[index];
+        slot.key = key;
+        slot.referenced = false;
+        shard.map.emplace(key, Handle(size_class, index));
+        return &slot;
+    }
+};
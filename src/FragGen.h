@@ -0,0 +1,179 @@
+#pragma once
+
+#include "PPData.h"
+#include "MassTable.h"
+#include "PackedSequences.h"
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// theoretical fragment spectrum of PPData peptides, residue masses come from the same
+// table as digestion, prefix sums and charge conversion are vectorized with SSE2,
+// ions are written into caller-provided buffers grouped by ion type, then by charge,
+// each group holding ions 1..n-1 (b1, b2, ... / y1, y2, ...)
+class FragmentGenerator {
+public:
+    enum IonType : unsigned {
+        kB = 1 << 0,
+        kY = 1 << 1,
+        kA = 1 << 2,
+        kC = 1 << 3,
+        kZ = 1 << 4,  // z+1 (z-dot) ions
+        kWaterLoss = 1 << 5,  // b-H2O and y-H2O
+        kAmmoniaLoss = 1 << 6,  // b-NH3 and y-NH3
+    };
+
+    FragmentGenerator(unsigned ion_types = kB | kY, unsigned max_charge = 1)
+            : max_charge_(max_charge), mass_table_(MassTable::Default()) {
+        if (max_charge == 0) { throw std::runtime_error("Fragment charge should be positive."); }
+        for (uint64_t code = 0; code < code_masses_.size(); ++code) {
+            code_masses_[code] = mass_table_[PackedSequences::Residue(code)];
+        }
+        // n-terminal series are offsets on prefix sums, c-terminal ones on suffix sums
+        const double co = 27.99491;
+        const double ammonia = 17.02655;
+        const double water = MassTable::Water();
+        if (ion_types & kB) { series_.push_back(Series{ false, 0 }); }
+        if (ion_types & kY) { series_.push_back(Series{ true, water }); }
+        if (ion_types & kA) { series_.push_back(Series{ false, -co }); }
+        if (ion_types & kC) { series_.push_back(Series{ false, ammonia }); }
+        if (ion_types & kZ) { series_.push_back(Series{ true, water - ammonia + MassTable::Hydrogen() }); }
+        if (ion_types & kWaterLoss) {
+            series_.push_back(Series{ false, -water });
+            series_.push_back(Series{ true, 0 });
+        }
+        if (ion_types & kAmmoniaLoss) {
+            series_.push_back(Series{ false, -ammonia });
+            series_.push_back(Series{ true, water - ammonia });
+        }
+    }
+
+    size_t series_num() const { return series_.size(); }
+    unsigned max_charge() const { return max_charge_; }
+
+    // buffer size needed for a peptide of the given length
+    size_t IonNum(size_t sequence_length) const {
+        return sequence_length < 2 ? 0 : series_.size() * max_charge_ * (sequence_length - 1);
+    }
+
+    // write IonNum(peptide.sequence_length) fragment m/z into ions, prefix is scratch
+    // of at least sequence_length doubles, return the number of ions written
+    size_t Generate(const PPData::Peptide& peptide, double* ions, double* prefix) const {
+        auto length = peptide.sequence_length;
+        if (length < 2) { return 0; }
+        for (size_t i = 0; i < length; ++i) { prefix[i] = mass_table_[peptide.sequence[i]]; }
+        return GenerateFromMasses(length, ions, prefix);
+    }
+
+    // the same for the residues [offset, offset + length) of a packed sequence, decoded
+    // 12 residues a word straight into masses
+    size_t Generate(const PackedSequences& packed, size_t index, size_t offset, size_t length,
+                    double* ions, double* prefix) const {
+        if (length < 2) { return 0; }
+        for (size_t i = 0; i < length; i += PackedSequences::kResiduesPerWord) {
+            auto window = packed.Window(index, offset + i);
+            auto end = std::min<size_t>(i + PackedSequences::kResiduesPerWord, length);
+            for (auto j = i; j < end; ++j) {
+                prefix[j] = code_masses_[window & PackedSequences::kCodeMask];
+                window >>= PackedSequences::kBits;
+            }
+        }
+        return GenerateFromMasses(length, ions, prefix);
+    }
+
+    // convenience overload reusing vectors owned by the caller
+    size_t Generate(const PPData::Peptide& peptide, std::vector<double>& ions, std::vector<double>& prefix) const {
+        ions.resize(IonNum(peptide.sequence_length));
+        if (prefix.size() < peptide.sequence_length) { prefix.resize(peptide.sequence_length); }
+        return Generate(peptide, ions.data(), prefix.data());
+    }
+
+private:
+    struct Series {
+        bool c_terminal;
+        double offset;  // added to the prefix / suffix sum to get the neutral ion mass
+    };
+
+    const unsigned max_charge_;
+    const MassTable& mass_table_;
+    std::vector<Series> series_;
+    std::array<double, 32> code_masses_;  // by PackedSequences code
+
+    // prefix holds the residue masses
+    size_t GenerateFromMasses(size_t length, double* ions, double* prefix) const {
+        PrefixSum(prefix, length);
+        auto total = prefix[length - 1];
+
+        auto ion_num = length - 1;
+        auto out = ions;
+        for (auto& series : series_) {
+            for (unsigned charge = 1; charge <= max_charge_; ++charge) {
+                auto offset = series.offset + charge * MassTable::Proton();
+                auto scale = 1.0 / charge;
+                if (!series.c_terminal) {
+                    Transform(prefix, ion_num, offset, scale, out);
+                }
+                else {  // suffix of k residues is total - prefix[n - 1 - k], written for k = 1..n-1
+                    TransformReversed(prefix, ion_num, total + offset, scale, out);
+                }
+                out += ion_num;
+            }
+        }
+        return out - ions;
+    }
+
+    // in-place inclusive prefix sum
+    static void PrefixSum(double* values, size_t length) {
+        size_t i = 0;
+#ifdef __SSE2__
+        auto carry = _mm_setzero_pd();
+        for (; i + 2 <= length; i += 2) {
+            auto v = _mm_loadu_pd(values + i);  // [x0, x1]
+            v = _mm_add_pd(v, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(v), 8)));  // [x0, x0 + x1]
+            v = _mm_add_pd(v, carry);
+            _mm_storeu_pd(values + i, v);
+            carry = _mm_unpackhi_pd(v, v);  // broadcast the running sum
+        }
+        auto sum = _mm_cvtsd_f64(carry);
+#else
+        double sum = 0;
+#endif
+        for (; i < length; ++i) {
+            sum += values[i];
+            values[i] = sum;
+        }
+    }
+
+    // out[i] = (prefix[i] + offset) * scale
+    static void Transform(const double* prefix, size_t num, double offset, double scale, double* out) {
+        size_t i = 0;
+#ifdef __SSE2__
+        auto offsets = _mm_set1_pd(offset);
+        auto scales = _mm_set1_pd(scale);
+        for (; i + 2 <= num; i += 2) {
+            auto v = _mm_loadu_pd(prefix + i);
+            _mm_storeu_pd(out + i, _mm_mul_pd(_mm_add_pd(v, offsets), scales));
+        }
+#endif
+        for (; i < num; ++i) { out[i] = (prefix[i] + offset) * scale; }
+    }
+
+    // out[i] = (base - prefix[num - 1 - i]) * scale
+    static void TransformReversed(const double* prefix, size_t num, double base, double scale, double* out) {
+        size_t i = 0;
+#ifdef __SSE2__
+        auto bases = _mm_set1_pd(base);
+        auto scales = _mm_set1_pd(scale);
+        for (; i + 2 <= num; i += 2) {
+            auto v = _mm_loadu_pd(prefix + num - 2 - i);  // [p(num-2-i), p(num-1-i)]
+            v = _mm_shuffle_pd(v, v, 1);  // reverse
+            _mm_storeu_pd(out + i, _mm_mul_pd(_mm_sub_pd(bases, v), scales));
+        }
+#endif
+        for (; i < num; ++i) { out[i] = (base - prefix[num - 1 - i]) * scale; }
+    }
+};
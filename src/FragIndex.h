@@ -0,0 +1,128 @@
+#pragma once
+
+#include "PPData.h"
+#include "MassTable.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// fragment-ion index over the peptides of a PPData, singly charged b/y ion masses are
+// bucketed by fragment mass bin, and each bin lists the ids of the peptides producing
+// it, since peptides are sorted by mass, ids in a bin are sorted by precursor mass too
+class FragIndex {
+public:
+    struct Candidate {
+        size_t index;  // peptide index in PPData
+        unsigned shared;  // number of spectrum peak bins matching a fragment of the peptide
+    };
+
+    // counters reused across queries, one per thread
+    class Workspace {
+    private:
+        friend class FragIndex;
+        std::vector<uint16_t> counts_;
+        std::vector<uint32_t> touched_;
+        std::vector<uint32_t> peak_bins_;
+    };
+
+    FragIndex(const PPData& ppdata, double bin_width = 1.0005079, double max_fragment_mass = 5000.0)
+            : ppdata_(ppdata), bin_width_(bin_width),
+              bin_num_(static_cast<size_t>(max_fragment_mass / bin_width) + 1) {
+        if (!(bin_width > 0)) { throw std::runtime_error("Fragment bin width should be positive."); }
+        if (ppdata.size() > UINT32_MAX) { throw std::runtime_error("Too many peptides for fragment index."); }
+
+        // count postings per bin, then fill them in peptide order
+        std::vector<uint32_t> bins;
+        offsets_.assign(bin_num_ + 1, 0);
+        for (size_t i = 0; i < ppdata.size(); ++i) {
+            FragmentBins(ppdata.peptide(i), bins);
+            for (auto bin : bins) { ++offsets_[bin + 1]; }
+        }
+        for (size_t bin = 0; bin < bin_num_; ++bin) { offsets_[bin + 1] += offsets_[bin]; }
+
+        postings_.resize(offsets_[bin_num_]);
+        std::vector<size_t> fill(offsets_.begin(), offsets_.end() - 1);
+        for (size_t i = 0; i < ppdata.size(); ++i) {
+            FragmentBins(ppdata.peptide(i), bins);
+            for (auto bin : bins) { postings_[fill[bin]++] = static_cast<uint32_t>(i); }
+        }
+    }
+
+    size_t bin_num() const { return bin_num_; }
+    double bin_width() const { return bin_width_; }
+    size_t posting_num() const { return postings_.size(); }
+
+    // score the peptides with precursor mass in [min_mass, max_mass] against the peaks
+    // (fragment m/z, taken as singly charged) by the number of shared fragment bins,
+    // candidates with at least min_shared are returned by decreasing count
+    void Query(const double* peaks, size_t peak_num, double min_mass, double max_mass, unsigned min_shared,
+               Workspace& workspace, std::vector<Candidate>& candidates) const {
+        candidates.clear();
+        auto first = ppdata_.lower_bound(min_mass);
+        auto last = ppdata_.upper_bound(max_mass);
+        if (first >= last) { return; }
+
+        // every bin counts once, however many peaks fall into it
+        auto& peak_bins = workspace.peak_bins_;
+        peak_bins.clear();
+        for (size_t i = 0; i < peak_num; ++i) {
+            auto bin = Bin(peaks[i]);
+            if (bin < bin_num_) { peak_bins.push_back(static_cast<uint32_t>(bin)); }
+        }
+        std::sort(peak_bins.begin(), peak_bins.end());
+        peak_bins.erase(std::unique(peak_bins.begin(), peak_bins.end()), peak_bins.end());
+
+        auto& counts = workspace.counts_;
+        auto& touched = workspace.touched_;
+        if (counts.size() < last - first) { counts.resize(last - first, 0); }
+        touched.clear();
+        for (auto bin : peak_bins) {
+            auto begin = postings_.data() + offsets_[bin];
+            auto end = postings_.data() + offsets_[bin + 1];
+            // restrict the bin to the precursor window
+            auto it = std::lower_bound(begin, end, static_cast<uint32_t>(first));
+            for (; it != end && *it < last; ++it) {
+                auto& count = counts[*it - first];
+                if (count == 0) { touched.push_back(*it); }
+                ++count;
+            }
+        }
+
+        for (auto id : touched) {
+            auto& count = counts[id - first];
+            if (count >= min_shared) { candidates.push_back(Candidate{ id, count }); }
+            count = 0;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& one, const Candidate& another) {
+            return one.shared != another.shared ? one.shared > another.shared : one.index < another.index;
+        });
+    }
+
+private:
+    const PPData& ppdata_;
+    const double bin_width_;
+    const size_t bin_num_;
+    std::vector<size_t> offsets_;  // postings of bin b are [offsets_[b], offsets_[b + 1])
+    std::vector<uint32_t> postings_;
+
+    size_t Bin(double mass) const { return static_cast<size_t>(mass / bin_width_); }
+
+    // distinct bins of the b1..b(n-1) and y1..y(n-1) ions
+    void FragmentBins(const PPData::Peptide& peptide, std::vector<uint32_t>& bins) const {
+        auto& mass_table = MassTable::Default();
+        bins.clear();
+        auto b = MassTable::Proton();
+        auto y = MassTable::Water() + MassTable::Proton();
+        for (size_t i = 0; i + 1 < peptide.sequence_length; ++i) {
+            b += mass_table[peptide.sequence[i]];
+            y += mass_table[peptide.sequence[peptide.sequence_length - 1 - i]];
+            auto b_bin = Bin(b);
+            auto y_bin = Bin(y);
+            if (b_bin < bin_num_) { bins.push_back(static_cast<uint32_t>(b_bin)); }
+            if (y_bin < bin_num_) { bins.push_back(static_cast<uint32_t>(y_bin)); }
+        }
+        std::sort(bins.begin(), bins.end());
+        bins.erase(std::unique(bins.begin(), bins.end()), bins.end());
+    }
+};
@@ -1,21 +1,59 @@
 #pragma once
 
 #include "PPData.h"
-//#include <city.h>
-#include <string>
+#include <cstdint>
 #include <cstring>
 
-// TODO: use cityhash
+// 8 residues with every I turned into L, without a branch, a byte is I exactly when it is
+// zero after xor with 'I', and 'I' ^ 'L' is 5, so peptides of a pack_sequences build,
+// which point into the sequences as read, hash and compare as their normalized sequences
+inline uint64_t NormalizeWord(uint64_t word) {
+    auto x = word ^ 0x4949494949494949ull;
+    auto zero = ~(((x & 0x7f7f7f7f7f7f7f7full) + 0x7f7f7f7f7f7f7f7full) | x) & 0x8080808080808080ull;
+    return word ^ ((zero >> 7) * ('I' ^ 'L'));
+}
+
+// 8 bytes at a time straight from the sequence, instead of through a std::string,
+// which allocates for every peptide longer than its small buffer, I and L hash alike
+inline uint64_t HashSequence(const char* sequence, size_t sequence_length) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ sequence_length;
+    size_t i = 0;
+    for (; i + 8 <= sequence_length; i += 8) {
+        uint64_t word;
+        memcpy(&word, sequence + i, 8);
+        hash = (hash ^ NormalizeWord(word)) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, sequence + i, sequence_length - i);
+    hash = (hash ^ NormalizeWord(tail)) * 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 29);
+}
+
+// I and L compare equal
+inline bool EqualSequences(const char* one, const char* another, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t one_word, another_word;
+        memcpy(&one_word, one + i, 8);
+        memcpy(&another_word, another + i, 8);
+        if (NormalizeWord(one_word) != NormalizeWord(another_word)) { return false; }
+    }
+    uint64_t one_tail = 0, another_tail = 0;
+    memcpy(&one_tail, one + i, length - i);
+    memcpy(&another_tail, another + i, length - i);
+    return NormalizeWord(one_tail) == NormalizeWord(another_tail);
+}
+
 namespace std {
     template<> struct hash<PPData::Peptide> {
         size_t operator()(const PPData::Peptide& p) const {
-            return (hash<string>()(string(p.sequence, p.sequence_length)));
-//            return CityHash32(p.sequence, p.sequence_length);
+            return static_cast<size_t>(HashSequence(p.sequence, p.sequence_length));
         }
     };
 }
 
 inline bool operator==(const PPData::Peptide& one, const PPData::Peptide& another) {
     if (one.sequence_length != another.sequence_length) { return false; }
-    return (0 == strncmp(one.sequence, another.sequence, one.sequence_length));
+    return EqualSequences(one.sequence, another.sequence, one.sequence_length);
 }
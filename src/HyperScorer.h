@@ -0,0 +1,152 @@
+#pragma once
+
+#include "PPData.h"
+#include "Spectrum.h"
+#include "FragGen.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// X!Tandem style hyperscore, a scorer for SearchDriver, each spectrum is preprocessed once
+// into a dense array of binned intensities (most intense peaks only, square root scaled,
+// normalized to 100), then a candidate is scored by looking up the bins of its b/y ions,
+// hyperscore = log10(sum of matched intensities * nb! * ny!), a peak is spread over the
+// bins within fragment_tolerance of its own, so that an ion is matched however close to
+// a bin edge the two fall
+class HyperScorer {
+public:
+    struct Context {
+        std::vector<float> bins;
+        std::vector<uint32_t> touched;  // non-zero bins, cleared on the next Prepare
+        std::vector<size_t> order;
+        std::vector<int32_t> ion_bins;
+        std::vector<double> ions;
+        std::vector<double> prefix;
+        bool fragment_charge_2 = false;
+    };
+
+    HyperScorer(double bin_width = 0.02, size_t top_peaks = 100, double max_fragment_mz = 5000.0,
+                double fragment_tolerance = 0.02)
+            : inverse_width_(1.0 / bin_width), top_peaks_(top_peaks),
+              bin_num_(static_cast<size_t>(max_fragment_mz / bin_width) + 2),
+              spread_(static_cast<size_t>(std::ceil(fragment_tolerance / bin_width))),
+              charge_1_(FragmentGenerator::kB | FragmentGenerator::kY, 1),
+              charge_2_(FragmentGenerator::kB | FragmentGenerator::kY, 2) {}
+
+    void Prepare(const Spectrum& spectrum, Context& context) const {
+        auto& bins = context.bins;
+        if (bins.size() != bin_num_) { bins.assign(bin_num_, 0); }
+        for (auto bin : context.touched) { bins[bin] = 0; }
+        context.touched.clear();
+        context.fragment_charge_2 = spectrum.charge >= 3;
+
+        // keep the most intense peaks
+        auto& order = context.order;
+        order.resize(spectrum.peak_num);
+        for (size_t i = 0; i < order.size(); ++i) { order[i] = i; }
+        if (order.size() > top_peaks_) {
+            std::nth_element(order.begin(), order.begin() + top_peaks_, order.end(), [&](size_t one, size_t another) {
+                return spectrum.intensity[one] > spectrum.intensity[another];
+            });
+            order.resize(top_peaks_);
+        }
+
+        float max_intensity = 0;
+        for (auto i : order) {
+            auto peak_bin = static_cast<size_t>(spectrum.mz[i] * inverse_width_);
+            if (peak_bin >= bin_num_ - 1 || !(spectrum.intensity[i] > 0)) { continue; }
+            auto intensity = static_cast<float>(std::sqrt(spectrum.intensity[i]));
+            auto first = peak_bin > spread_ ? peak_bin - spread_ : 0;
+            auto last = std::min(peak_bin + spread_, bin_num_ - 2);  // last bin stays 0
+            for (auto bin = first; bin <= last; ++bin) {
+                if (bins[bin] == 0) { context.touched.push_back(static_cast<uint32_t>(bin)); }
+                bins[bin] = std::max(bins[bin], intensity);
+            }
+            max_intensity = std::max(max_intensity, intensity);
+        }
+        if (max_intensity > 0) {
+            for (auto bin : context.touched) { bins[bin] *= 100 / max_intensity; }
+        }
+    }
+
+    double Score(const PPData::Peptide& peptide, Context& context) const {
+        auto& generator = context.fragment_charge_2 ? charge_2_ : charge_1_;
+        auto ion_num = generator.Generate(peptide, context.ions, context.prefix);
+        if (ion_num == 0) { return 0; }
+        auto& ion_bins = context.ion_bins;
+        ion_bins.resize(ion_num);
+        ToBins(context.ions.data(), ion_num, ion_bins.data());
+
+        // b ions are the first half of the ladder (every charge), y ions the second half
+        auto half = ion_num / 2;
+        float b_sum, y_sum;
+        unsigned b_num, y_num;
+        Accumulate(context.bins.data(), ion_bins.data(), half, b_sum, b_num);
+        Accumulate(context.bins.data(), ion_bins.data() + half, half, y_sum, y_num);
+        auto dot = static_cast<double>(b_sum) + y_sum;
+        if (!(dot > 0)) { return 0; }
+        return std::log10(dot) + (std::lgamma(b_num + 1.0) + std::lgamma(y_num + 1.0)) / std::log(10.0);
+    }
+
+private:
+    const double inverse_width_;
+    const size_t top_peaks_;
+    const size_t bin_num_;
+    const size_t spread_;  // bins on each side of a peak within the fragment tolerance
+    const FragmentGenerator charge_1_;
+    const FragmentGenerator charge_2_;
+
+    // bin of every ion, ions out of range go to the last bin, which is always 0
+    void ToBins(const double* ions, size_t num, int32_t* out) const {
+        const auto last = static_cast<int32_t>(bin_num_ - 1);
+        size_t i = 0;
+#ifdef __SSE2__
+        auto scale = _mm_set1_pd(inverse_width_);
+        auto limit = _mm_set1_pd(static_cast<double>(last));
+        for (; i + 2 <= num; i += 2) {
+            auto value = _mm_min_pd(_mm_mul_pd(_mm_loadu_pd(ions + i), scale), limit);
+            auto bins = _mm_cvttpd_epi32(value);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), bins);
+        }
+#endif
+        for (; i < num; ++i) {
+            auto value = std::min(ions[i] * inverse_width_, static_cast<double>(last));
+            out[i] = static_cast<int32_t>(value);
+        }
+    }
+
+    // branch-free sum and count of the non-zero bins
+    static void Accumulate(const float* bins, const int32_t* ion_bins, size_t num, float& sum, unsigned& count) {
+        size_t i = 0;
+#ifdef __SSE2__
+        auto sums = _mm_setzero_ps();
+        auto counts = _mm_setzero_ps();
+        auto ones = _mm_set1_ps(1.0f);
+        for (; i + 4 <= num; i += 4) {
+            auto values = _mm_set_ps(bins[ion_bins[i + 3]], bins[ion_bins[i + 2]],
+                                     bins[ion_bins[i + 1]], bins[ion_bins[i]]);
+            sums = _mm_add_ps(sums, values);
+            counts = _mm_add_ps(counts, _mm_and_ps(_mm_cmpgt_ps(values, _mm_setzero_ps()), ones));
+        }
+        float sum_lanes[4];
+        float count_lanes[4];
+        _mm_storeu_ps(sum_lanes, sums);
+        _mm_storeu_ps(count_lanes, counts);
+        sum = sum_lanes[0] + sum_lanes[1] + sum_lanes[2] + sum_lanes[3];
+        auto total = count_lanes[0] + count_lanes[1] + count_lanes[2] + count_lanes[3];
+#else
+        sum = 0;
+        float total = 0;
+#endif
+        for (; i < num; ++i) {
+            auto value = bins[ion_bins[i]];
+            sum += value;
+            total += value > 0 ? 1.0f : 0.0f;
+        }
+        count = static_cast<unsigned>(total);
+    }
+};
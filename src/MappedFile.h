@@ -0,0 +1,63 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only view of a whole file, memory mapped where the platform allows it
+class MappedFile {
+public:
+    explicit MappedFile(const char* filename) {
+#ifndef _WIN32
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) { throw std::runtime_error("Fail to open file for mapping."); }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Fail to stat file for mapping.");
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Fail to map file.");
+            }
+            data_ = static_cast<const char*>(addr);
+        }
+        close(fd);  // the mapping stays valid after closing
+#else
+        std::basic_ifstream<char> file(filename, std::ios::binary);
+        if (!file) { throw std::runtime_error("Fail to open file for mapping."); }
+        file.seekg(0, std::ios::end);
+        size_ = static_cast<size_t>(file.tellg());
+        file.seekg(0);
+        buffer_.resize(size_);
+        file.read(buffer_.data(), static_cast<std::streamsize>(size_));
+        data_ = buffer_.data();
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data_ != nullptr) { munmap(const_cast<char*>(data_), size_); }
+#endif
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    std::vector<char> buffer_;
+#endif
+};
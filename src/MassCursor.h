@@ -0,0 +1,76 @@
+#pragma once
+
+#include "PPData.h"
+#include <cstddef>
+#include <algorithm>
+
+// peptide index range [first, last)
+struct PeptideSpan {
+    size_t first;
+    size_t last;
+
+    size_t size() const { return last - first; }
+    bool empty() const { return first >= last; }
+};
+
+// sliding window over the mass-sorted peptides of PPData, for queries of increasing mass
+// (e.g. spectra sorted by precursor mass) both ends only move forward, galloping from
+// where they stopped, so a sequence of windows costs amortized O(1) each instead of two
+// binary searches, a query going backwards is answered by binary search and restarts there,
+// such restarts are counted
+class MassCursor {
+public:
+    explicit MassCursor(const PPData& ppdata) : ppdata_(ppdata) {}
+
+    // peptides of mass in [min_mass, max_mass]
+    PeptideSpan Advance(double min_mass, double max_mass) {
+        if (!started_ || min_mass < min_mass_ || max_mass < max_mass_) {
+            restart_num_ += started_;
+            first_ = ppdata_.lower_bound(min_mass);
+            last_ = ppdata_.upper_bound(max_mass);
+            started_ = true;
+        }
+        else {
+            first_ = Gallop(first_, [&](size_t i) { return ppdata_.mass(i) < min_mass; });
+            last_ = Gallop(last_, [&](size_t i) { return ppdata_.mass(i) <= max_mass; });
+        }
+        min_mass_ = min_mass;
+        max_mass_ = max_mass;
+        return PeptideSpan{ first_, std::max(first_, last_) };
+    }
+
+    // queries answered by binary search after the first one
+    size_t restart_num() const { return restart_num_; }
+
+private:
+    const PPData& ppdata_;
+    bool started_ = false;
+    double min_mass_ = 0;
+    double max_mass_ = 0;
+    size_t first_ = 0;
+    size_t last_ = 0;
+    size_t restart_num_ = 0;
+
+    // first index from start on where before() turns false, before() being monotone
+    template <typename Before>
+    size_t Gallop(size_t start, Before&& before) const {
+        auto size = ppdata_.size();
+        if (start >= size || !before(start)) { return start; }
+        // before(low) holds, find high with !before(high) by doubling steps
+        size_t low = start;
+        size_t step = 1;
+        size_t high = low + step;
+        while (high < size && before(high)) {
+            low = high;
+            step *= 2;
+            high = low + step;
+        }
+        if (high > size) { high = size; }
+        while (high - low > 1) {
+            auto middle = low + (high - low) / 2;
+            if (before(middle)) { low = middle; }
+            else { high = middle; }
+        }
+        return high;
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// histogram of precursor mass shifts (precursor mass - peptide mass) of the best matches
+// of an open search, modifications show up as peaks, e.g. +79.966 for phosphorylation,
+// every bin also sums its shifts, so that a peak is reported at the mean of its shifts
+class MassShiftHistogram {
+public:
+    struct Peak {
+        double shift;
+        size_t count;
+    };
+
+    MassShiftHistogram(double min_shift, double max_shift, double bin_width = 0.01)
+            : min_shift_(min_shift), inverse_width_(1.0 / bin_width),
+              counts_(static_cast<size_t>(std::ceil((max_shift - min_shift) / bin_width)) + 1, 0),
+              sums_(counts_.size(), 0) {
+        if (!(max_shift > min_shift) || !(bin_width > 0)) { throw std::runtime_error("Invalid mass shift range."); }
+    }
+
+    void Clear() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        std::fill(sums_.begin(), sums_.end(), 0);
+        total_ = 0;
+    }
+
+    // shifts out of range are ignored
+    void Add(double shift) {
+        auto value = (shift - min_shift_) * inverse_width_;
+        if (!(value >= 0) || value >= counts_.size()) { return; }
+        auto bin = static_cast<size_t>(value);
+        ++counts_[bin];
+        sums_[bin] += shift;
+        ++total_;
+    }
+
+    void Merge(const MassShiftHistogram& other) {
+        if (other.counts_.size() != counts_.size() || other.min_shift_ != min_shift_
+                || other.inverse_width_ != inverse_width_) {
+            throw std::runtime_error("Merging mass shift histograms of different ranges.");
+        }
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+            sums_[i] += other.sums_[i];
+        }
+        total_ += other.total_;
+    }
+
+    size_t total() const { return total_; }
+
+    // local maxima (over +-radius bins) of at least min_count, by decreasing count
+    std::vector<Peak> Peaks(size_t min_count, size_t radius = 2) const {
+        std::vector<Peak> peaks;
+        auto size = counts_.size();
+        for (size_t i = 0; i < size; ++i) {
+            if (counts_[i] < std::max<size_t>(min_count, 1)) { continue; }
+            bool maximum = true;
+            auto begin = i >= radius ? i - radius : 0;
+            auto end = std::min(size, i + radius + 1);
+            for (auto j = begin; j < end && maximum; ++j) {
+                // ties go to the leftmost bin
+                maximum = j < i ? counts_[j] < counts_[i] : counts_[j] <= counts_[i];
+            }
+            if (maximum) { peaks.push_back(Peak{ sums_[i] / counts_[i], counts_[i] }); }
+        }
+        std::stable_sort(peaks.begin(), peaks.end(), [](const Peak& one, const Peak& another) {
+            return one.count > another.count;
+        });
+        return peaks;
+    }
+
+private:
+    const double min_shift_;
+    const double inverse_width_;
+    std::vector<size_t> counts_;
+    std::vector<double> sums_;
+    size_t total_ = 0;
+};
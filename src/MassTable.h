@@ -0,0 +1,46 @@
+#pragma once
+
+// monoisotopic residue and terminal masses, shared by digestion and fragment generation,
+// residues are looked up by character in a flat array, unknown residues have mass 0
+class MassTable {
+public:
+    MassTable() {
+        for (auto& mass : masses_) { mass = 0; }
+        masses_['G'] = 57.02147;
+        masses_['A'] = 71.03712;
+        masses_['S'] = 87.03203;
+        masses_['P'] = 97.05277;
+        masses_['V'] = 99.06842;
+        masses_['T'] = 101.04768;
+        masses_['C'] = 103.00919 + 57.021464;  // Fixed Mod on C
+        masses_['I'] = 113.08407;
+        masses_['L'] = 113.08407;
+        masses_['N'] = 114.04293;
+        masses_['D'] = 115.02695;
+        masses_['Q'] = 128.05858;
+        masses_['K'] = 128.09497;
+        masses_['E'] = 129.04260;
+        masses_['M'] = 131.04049;
+        masses_['H'] = 137.05891;
+        masses_['F'] = 147.06842;
+        masses_['R'] = 156.10112;
+        masses_['Y'] = 163.06333;
+        masses_['W'] = 186.07932;
+    }
+
+    static const MassTable& Default() {
+        static const MassTable table;
+        return table;
+    }
+
+    double operator[](char residue) const { return masses_[static_cast<unsigned char>(residue)]; }
+    const double* data() const { return masses_; }
+
+    static constexpr double Proton() { return 1.00727; }
+    static constexpr double Hydrogen() { return 1.00782; }
+    static constexpr double Oxygen() { return 15.99491; }
+    static constexpr double Water() { return Oxygen() + Hydrogen() + Hydrogen(); }
+
+private:
+    double masses_[256];
+};
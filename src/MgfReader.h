@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Spectrum.h"
+#include "MappedFile.h"
+#include "ParseNumber.h"
+#include <cstring>
+
+// streaming reader of MGF files, the file is memory mapped and parsed in place, titles
+// point into the mapping, and spectra are returned in batches of reusable storage
+class MgfReader {
+public:
+    // default_charge is used for spectra without a CHARGE line
+    explicit MgfReader(const char* filename, unsigned default_charge = 2)
+            : file_(filename), cursor_(file_.data()), end_(file_.data() + file_.size()),
+              default_charge_(default_charge) {}
+
+    // read up to max_spectra spectra into batch, return how many, 0 at the end of file
+    size_t NextBatch(SpectrumBatch& batch, size_t max_spectra) {
+        batch.Clear();
+        while (batch.size() < max_spectra && ReadSpectrum(batch)) {}
+        batch.Finish();
+        return batch.size();
+    }
+
+private:
+    MappedFile file_;
+    const char* cursor_;
+    const char* const end_;
+    const unsigned default_charge_;
+
+    // next line without line break and surrounding blanks, false at the end of file
+    bool NextLine(const char*& begin, const char*& end) {
+        while (cursor_ < end_) {
+            auto newline = static_cast<const char*>(std::memchr(cursor_, '\n', end_ - cursor_));
+            auto line_end = newline != nullptr ? newline : end_;
+            begin = cursor_;
+            end = line_end;
+            cursor_ = newline != nullptr ? newline + 1 : end_;
+            while (begin < end && (*begin == ' ' || *begin == '\t')) { ++begin; }
+            while (begin < end && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) { --end; }
+            if (begin < end) { return true; }
+        }
+        return false;
+    }
+
+    static bool StartsWith(const char* begin, const char* end, const char* prefix) {
+        auto length = std::strlen(prefix);
+        return static_cast<size_t>(end - begin) >= length && std::memcmp(begin, prefix, length) == 0;
+    }
+
+    // parse BEGIN IONS ... END IONS, spectra without PEPMASS are skipped
+    bool ReadSpectrum(SpectrumBatch& batch) {
+        const char* begin;
+        const char* end;
+        while (true) {
+            do {
+                if (!NextLine(begin, end)) { return false; }
+            } while (!StartsWith(begin, end, "BEGIN IONS"));
+
+            const char* title = nullptr;
+            size_t title_length = 0;
+            double precursor_mz = 0;
+            unsigned charge = 0;
+            bool has_precursor = false;
+            bool added = false;
+            while (NextLine(begin, end)) {
+                if (unsigned(*begin - '0') < 10) {  // peak line
+                    if (!added) {
+                        if (!has_precursor) { continue; }
+                        batch.AddSpectrum(title, title_length, precursor_mz, charge != 0 ? charge : default_charge_);
+                        added = true;
+                    }
+                    double mz;
+                    double intensity = 0;
+                    auto p = ParseDouble(begin, end, mz);
+                    while (p != nullptr && p < end && (*p == ' ' || *p == '\t')) { ++p; }
+                    if (p != nullptr && p < end) { ParseDouble(p, end, intensity); }
+                    if (p != nullptr) { batch.AddPeak(mz, intensity); }
+                }
+                else if (StartsWith(begin, end, "END IONS")) {
+                    break;
+                }
+                else if (StartsWith(begin, end, "TITLE=")) {
+                    title = begin + 6;
+                    title_length = end - title;
+                }
+                else if (StartsWith(begin, end, "PEPMASS=")) {
+                    has_precursor = ParseDouble(begin + 8, end, precursor_mz) != nullptr;
+                }
+                else if (StartsWith(begin, end, "CHARGE=")) {
+                    ParseUnsigned(begin + 7, end, charge);  // "2+", "2+ and 3+" takes the first
+                }
+            }
+            if (!added && has_precursor) {  // spectrum without peaks
+                batch.AddSpectrum(title, title_length, precursor_mz, charge != 0 ? charge : default_charge_);
+                added = true;
+            }
+            if (added) { return true; }
+        }
+    }
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "Spectrum.h"
+#include "Base64.h"
+#include "ParseNumber.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#ifdef PPDATA_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+// streaming reader of MS2 spectra (precursor m/z, charge and peaks) from mzML, the file is
+// read in chunks and only the current <spectrum> element is kept in memory, so memory is
+// bounded by the chunk size plus the largest spectrum, binary arrays are base64 decoded
+// and inflated with zlib when compressed (requires building with PPDATA_WITH_ZLIB)
+class MzmlReader {
+public:
+    // default_charge is used for precursors without a charge state
+    explicit MzmlReader(const char* filename, size_t chunk_size = 1 << 20, unsigned default_charge = 2)
+            : file_(filename, std::ios::binary), chunk_size_(std::max<size_t>(chunk_size, 4096)),
+              default_charge_(default_charge) {
+        if (!file_) { throw std::runtime_error("Fail to open mzML file."); }
+    }
+
+    // read up to max_spectra MS2 spectra into batch, return how many, 0 at the end of file
+    size_t NextBatch(SpectrumBatch& batch, size_t max_spectra) {
+        batch.Clear();
+        const char* begin;
+        const char* end;
+        while (batch.size() < max_spectra && NextElement(begin, end)) {
+            ParseSpectrum(begin, end, batch);
+        }
+        batch.Finish();
+        return batch.size();
+    }
+
+private:
+    std::ifstream file_;
+    const size_t chunk_size_;
+    const unsigned default_charge_;
+    std::vector<char> buffer_;
+    size_t start_ = 0;  // unconsumed data is buffer_[start_, buffer_.size())
+    bool eof_ = false;
+    std::vector<uint8_t> decoded_;
+    std::vector<uint8_t> inflated_;
+    std::vector<double> mz_;
+    std::vector<double> intensity_;
+
+    static const char* Find(const char* begin, const char* end, const char* needle) {
+        auto found = std::search(begin, end, needle, needle + std::strlen(needle));
+        return found == end ? nullptr : found;
+    }
+
+    // append one chunk of the file, keeping only unconsumed data
+    bool Fill() {
+        if (eof_) { return false; }
+        buffer_.erase(buffer_.begin(), buffer_.begin() + start_);
+        start_ = 0;
+        auto size = buffer_.size();
+        buffer_.resize(size + chunk_size_);
+        file_.read(buffer_.data() + size, static_cast<std::streamsize>(chunk_size_));
+        auto read = static_cast<size_t>(file_.gcount());
+        buffer_.resize(size + read);
+        if (read < chunk_size_) { eof_ = true; }
+        return read > 0;
+    }
+
+    // next complete <spectrum ...>...</spectrum> element in the buffer
+    bool NextElement(const char*& begin, const char*& end) {
+        const char open[] = "<spectrum";
+        const char close[] = "</spectrum>";
+        while (true) {
+            auto data = buffer_.data();
+            auto found = Find(data + start_, data + buffer_.size(), open);
+            // the tag name must end here, which rules out <spectrumList
+            while (found != nullptr && found + sizeof(open) - 1 < data + buffer_.size()
+                       && !std::strchr(" \t\r\n>", found[sizeof(open) - 1])) {
+                found = Find(found + 1, data + buffer_.size(), open);
+            }
+            if (found == nullptr || found + sizeof(open) - 1 >= data + buffer_.size()) {
+                // keep a possible partial tag at the end, drop the rest
+                if (found == nullptr) { start_ = std::max(start_, buffer_.size() - std::min(buffer_.size() - start_, sizeof(open))); }
+                else { start_ = found - data; }
+                if (!Fill()) { return false; }
+                continue;
+            }
+            start_ = found - data;
+            auto closing = Find(found, data + buffer_.size(), close);
+            if (closing == nullptr) {
+                if (!Fill()) { return false; }
+                continue;
+            }
+            begin = found;
+            end = closing + sizeof(close) - 1;
+            start_ = end - data;
+            return true;
+        }
+    }
+
+    // value="..." of the cvParam with the given accession, within [begin, end)
+    static bool CvParamValue(const char* begin, const char* end, const char* accession,
+                             const char*& value_begin, const char*& value_end) {
+        auto found = Find(begin, end, accession);
+        if (found == nullptr) { return false; }
+        auto tag_begin = found;
+        while (tag_begin > begin && *tag_begin != '<') { --tag_begin; }
+        auto tag_end = std::find(found, end, '>');
+        auto value = Find(tag_begin, tag_end, "value=\"");
+        if (value == nullptr) { return false; }
+        value_begin = value + 7;
+        value_end = std::find(value_begin, tag_end, '"');
+        return true;
+    }
+
+    void ParseSpectrum(const char* begin, const char* end, SpectrumBatch& batch) {
+        const char* value;
+        const char* value_end;
+        unsigned ms_level = 0;
+        if (!CvParamValue(begin, end, "\"MS:1000511\"", value, value_end)
+                || ParseUnsigned(value, value_end, ms_level) == nullptr || ms_level != 2) {
+            return;
+        }
+        double precursor_mz = 0;
+        if (!CvParamValue(begin, end, "\"MS:1000744\"", value, value_end)
+                || ParseDouble(value, value_end, precursor_mz) == nullptr) {
+            return;
+        }
+        unsigned charge = 0;
+        if (CvParamValue(begin, end, "\"MS:1000041\"", value, value_end)) { ParseUnsigned(value, value_end, charge); }
+
+        const char* id = begin;
+        const char* id_end = begin;
+        auto tag_end = std::find(begin, end, '>');
+        auto id_attribute = Find(begin, tag_end, " id=\"");
+        if (id_attribute != nullptr) {
+            id = id_attribute + 5;
+            id_end = std::find(id, tag_end, '"');
+        }
+
+        mz_.clear();
+        intensity_.clear();
+        for (auto array = Find(begin, end, "<binaryDataArray"); array != nullptr;
+                array = Find(array + 1, end, "<binaryDataArray")) {
+            auto array_end = Find(array, end, "</binaryDataArray>");
+            if (array_end == nullptr) { break; }
+            std::vector<double>* values = nullptr;
+            if (Find(array, array_end, "\"MS:1000514\"") != nullptr) { values = &mz_; }
+            else if (Find(array, array_end, "\"MS:1000515\"") != nullptr) { values = &intensity_; }
+            else { continue; }
+            DecodeArray(array, array_end, *values);
+        }
+
+        batch.AddSpectrumCopy(id, id_end - id, precursor_mz, charge != 0 ? charge : default_charge_);
+        auto peak_num = std::min(mz_.size(), intensity_.size());
+        for (size_t i = 0; i < peak_num; ++i) { batch.AddPeak(mz_[i], intensity_[i]); }
+    }
+
+    void DecodeArray(const char* begin, const char* end, std::vector<double>& values) {
+        auto binary = Find(begin, end, "<binary>");
+        if (binary == nullptr) { return; }
+        binary += 8;
+        auto binary_end = std::find(binary, end, '<');
+        decoded_.resize(3 * (binary_end - binary) / 4 + 16);
+        decoded_.resize(Base64::Decode(binary, binary_end - binary, decoded_.data()));
+
+        const std::vector<uint8_t>* bytes = &decoded_;
+        if (Find(begin, end, "\"MS:1000574\"") != nullptr) {  // zlib compression
+#ifdef PPDATA_WITH_ZLIB
+            Inflate(decoded_, inflated_);
+            bytes = &inflated_;
+#else
+            throw std::runtime_error("zlib compressed mzML requires building with zlib.");
+#endif
+        }
+
+        bool single = Find(begin, end, "\"MS:1000521\"") != nullptr;  // 32-bit float, default 64-bit
+        auto width = single ? sizeof(float) : sizeof(double);
+        auto num = bytes->size() / width;
+        values.resize(num);
+        for (size_t i = 0; i < num; ++i) {  // mzML arrays are little endian
+            if (single) {
+                float value;
+                std::memcpy(&value, bytes->data() + i * width, sizeof(value));
+                values[i] = value;
+            }
+            else {
+                std::memcpy(&values[i], bytes->data() + i * width, sizeof(double));
+            }
+        }
+    }
+
+#ifdef PPDATA_WITH_ZLIB
+    static void Inflate(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+        z_stream stream = {};
+        if (inflateInit(&stream) != Z_OK) { throw std::runtime_error("Fail to initialize zlib."); }
+        stream.next_in = const_cast<Bytef*>(input.data());
+        stream.avail_in = static_cast<uInt>(input.size());
+        output.resize(std::max<size_t>(input.size() * 4, 1024));
+        size_t written = 0;
+        int status;
+        do {
+            if (written == output.size()) { output.resize(output.size() * 2); }
+            stream.next_out = output.data() + written;
+            stream.avail_out = static_cast<uInt>(output.size() - written);
+            status = inflate(&stream, Z_NO_FLUSH);
+            written = output.size() - stream.avail_out;
+        } while (status == Z_OK);
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END) { throw std::runtime_error("Corrupted zlib data in mzML."); }
+        output.resize(written);
+    }
+#endif
+};
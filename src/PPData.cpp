@@ -3,6 +3,12 @@
 #include "PPData.h"
 #include "ProtData.h"
 #include "PeptData.h"
+#include "PeptTable.h"
+#include "ExternalBuilder.h"
+#include "ShardPlanner.h"
+#include "BuildState.h"
+#include "BuildRecorder.h"
+#include <ostream>
 
 // data interface ctor
 PPData::Protein::Protein(const char* name, const char* sequence, size_t sequence_length)
@@ -18,30 +24,159 @@ PPData::Peptide::Peptide(const Protein& protein, const char* compact_protein_seq
           protein(&protein),
           offset(start_idx) {}
 
-// wrapper implementation
+// incremental build, the state file is loaded before and rewritten after digestion
+static PeptData BuildIncremental(const ProtData& prot_data, const PPData::Options& options,
+                                 const char* state_filename, BuildRecorder* recorder) {
+    auto state = BuildState::Load(state_filename);
+    PeptData pept_data(prot_data, options, state, recorder);
+    state.Save(state_filename);
+    return pept_data;
+}
+
+// wrapper implementation, report_ and recorder_ come first, they are used while building
 class PPData::Impl {
 public:
-    Impl(const char* filename, bool append_decoy, EnzymeType enzyme_type,
-         unsigned max_miss_cleavage, double min_mass, double max_mass)
-            : prot_data_(filename, append_decoy),
-              pept_data_(prot_data_, enzyme_type, max_miss_cleavage, min_mass, max_mass) {}
+    Impl(const char* filename, const Options& options)
+            : recorder_(report_),
+              prot_data_(filename, options.append_decoy, &recorder_, options.normalize_in_place),
+              pept_data_(prot_data_, options, &recorder_) {}
+    Impl(const char* filename, const Options& options, const char* state_filename)
+            : recorder_(report_),
+              prot_data_(filename, options.append_decoy, &recorder_, options.normalize_in_place),
+              pept_data_(BuildIncremental(prot_data_, options, state_filename, &recorder_)) {}
+    Impl(const char* filename, bool append_decoy, const char* table_filename)
+            : recorder_(report_),
+              prot_data_(filename, append_decoy, &recorder_),
+              pept_data_(prot_data_, std::make_shared<const PeptTable>(table_filename), &recorder_) {}
+    Impl(const Impl& impl)
+            : report_(impl.report_), recorder_(report_),
+              prot_data_(impl.prot_data_), pept_data_(impl.pept_data_) {}
 
     size_t size() const { return pept_data_.size(); }
     const Peptide& operator[](const size_t index) const { return pept_data_[index]; }
+    Peptide peptide(const size_t index) const { return pept_data_.Get(prot_data_, index); }
+    double mass(const size_t index) const { return pept_data_.mass(index); }
+    size_t lower_bound(double lower_mass) const { return pept_data_.lower_bound(lower_mass); }
+    size_t upper_bound(double upper_mass) const { return pept_data_.upper_bound(upper_mass); }
+    const BuildReport& report() const { return report_; }
+    const PackedSequences* packed_sequences() const { return pept_data_.packed_sequences(); }
 
 private:
+    BuildReport report_;
+    BuildRecorder recorder_;
     ProtData prot_data_;
     PeptData pept_data_;
 };
 
+static PPData::Options MakeOptions(bool append_decoy, PPData::EnzymeType enzyme_type,
+                                   unsigned max_miss_cleavage, double min_mass, double max_mass) {
+    PPData::Options options;
+    options.append_decoy = append_decoy;
+    options.enzyme_type = enzyme_type;
+    options.max_miss_cleavage = max_miss_cleavage;
+    options.min_mass = min_mass;
+    options.max_mass = max_mass;
+    return options;
+}
+
 // container ctor
+PPData::PPData(const char* filename, const Options& options)
+               : pImpl(std::make_unique<Impl>(filename, options)) {}
 PPData::PPData(const char* filename, bool append_decoy, EnzymeType enzyme_type,
                unsigned max_miss_cleavage, double min_mass, double max_mass)
-               : pImpl(std::make_unique<Impl>(filename, append_decoy, enzyme_type,
-                                              max_miss_cleavage, min_mass, max_mass)) {}
+               : PPData(filename, MakeOptions(append_decoy, enzyme_type, max_miss_cleavage, min_mass, max_mass)) {}
+PPData::PPData(const char* filename, const Options& options, const char* state_filename)
+               : pImpl(std::make_unique<Impl>(filename, options, state_filename)) {}
+PPData::PPData(const char* filename, bool append_decoy, EnzymeType enzyme_type,
+               unsigned max_miss_cleavage, double min_mass, double max_mass, const char* state_filename)
+               : PPData(filename, MakeOptions(append_decoy, enzyme_type, max_miss_cleavage, min_mass, max_mass),
+                        state_filename) {}
+PPData::PPData(const char* filename, bool append_decoy, const char* table_filename)
+               : pImpl(std::make_unique<Impl>(filename, append_decoy, table_filename)) {}
 PPData::PPData(const PPData& ppdata) : pImpl(new Impl(*ppdata.pImpl)) {}
 PPData::~PPData() {}
 
 // adapters
 size_t PPData::size() const { return pImpl->size(); }
 const PPData::Peptide& PPData::operator[](const size_t index) const { return pImpl->operator[](index); }
+PPData::Peptide PPData::peptide(const size_t index) const { return pImpl->peptide(index); }
+double PPData::mass(const size_t index) const { return pImpl->mass(index); }
+size_t PPData::lower_bound(double lower_mass) const { return pImpl->lower_bound(lower_mass); }
+size_t PPData::upper_bound(double upper_mass) const { return pImpl->upper_bound(upper_mass); }
+const PPData::BuildReport& PPData::build_report() const { return pImpl->report(); }
+const PackedSequences* PPData::packed_sequences() const { return pImpl->packed_sequences(); }
+
+// build report
+const PPData::BuildStage* PPData::BuildReport::stage(const char* name) const {
+    for (auto& stage : stages) {
+        if (stage.name == name) { return &stage; }
+    }
+    return nullptr;
+}
+
+void PPData::BuildReport::WriteJson(std::ostream& out) const {
+    auto precision = out.precision(9);
+    out << "{\"stages\": [";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        auto& stage = stages[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "  {\"name\": \"" << stage.name << "\", \"start_seconds\": " << stage.start_seconds
+            << ", \"wall_seconds\": " << stage.wall_seconds << ", \"cpu_seconds\": " << stage.cpu_seconds
+            << ", \"allocations\": " << stage.allocations << ", \"bytes_allocated\": " << stage.bytes_allocated
+            << ", \"buffer_bytes\": " << stage.buffer_bytes
+            << ", \"items_in\": " << stage.items_in << ", \"items_out\": " << stage.items_out << "}";
+    }
+    out << "\n]}\n";
+    out.precision(precision);
+}
+
+void PPData::BuildReport::WriteChromeTrace(std::ostream& out) const {
+    auto precision = out.precision(9);
+    out << "{\"traceEvents\": [";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        auto& stage = stages[i];
+        // complete events, times in microseconds
+        out << (i == 0 ? "\n" : ",\n")
+            << "  {\"name\": \"" << stage.name << "\", \"cat\": \"build\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"
+            << ", \"ts\": " << stage.start_seconds * 1e6 << ", \"dur\": " << stage.wall_seconds * 1e6
+            << ", \"args\": {\"cpu_seconds\": " << stage.cpu_seconds << ", \"allocations\": " << stage.allocations
+            << ", \"bytes_allocated\": " << stage.bytes_allocated << ", \"buffer_bytes\": " << stage.buffer_bytes
+            << ", \"items_in\": " << stage.items_in << ", \"items_out\": " << stage.items_out << "}}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    out.precision(precision);
+}
+
+// digestion rules of options
+static Digester MakeDigester(const PPData::Options& options) {
+    return Digester(EnzymeMask(options), options.max_miss_cleavage, options.min_mass, options.max_mass,
+                    options.min_length, options.max_length);
+}
+
+// out-of-core builder
+size_t PPData::BuildTable(const char* filename, const Options& options,
+                          const char* table_filename, size_t memory_budget) {
+    ProtData prot_data(filename, options.append_decoy, nullptr, options.normalize_in_place);
+    auto digester = MakeDigester(options);
+    return ExternalBuilder(prot_data, digester, memory_budget, options.filter).Build(table_filename, options.append_decoy);
+}
+size_t PPData::BuildTable(const char* filename, bool append_decoy, EnzymeType enzyme_type,
+                          unsigned max_miss_cleavage, double min_mass, double max_mass,
+                          const char* table_filename, size_t memory_budget) {
+    return BuildTable(filename, MakeOptions(append_decoy, enzyme_type, max_miss_cleavage, min_mass, max_mass),
+                      table_filename, memory_budget);
+}
+
+// shard planner
+std::vector<PPData::Shard> PPData::PlanShards(const char* filename, const Options& options,
+                                              unsigned shard_num, double margin) {
+    ProtData prot_data(filename, options.append_decoy, nullptr, options.normalize_in_place);
+    auto digester = MakeDigester(options);
+    return ShardPlanner(prot_data, digester, options.filter).Plan(shard_num, margin);
+}
+std::vector<PPData::Shard> PPData::PlanShards(const char* filename, bool append_decoy, EnzymeType enzyme_type,
+                                              unsigned max_miss_cleavage, double min_mass, double max_mass,
+                                              unsigned shard_num, double margin) {
+    return PlanShards(filename, MakeOptions(append_decoy, enzyme_type, max_miss_cleavage, min_mass, max_mass),
+                      shard_num, margin);
+}
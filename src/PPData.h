@@ -3,6 +3,12 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <functional>
+#include <vector>
+#include <iosfwd>
+
+class PackedSequences;
 
 class PPData {
 public:
@@ -15,6 +21,9 @@ public:
     };
 
     struct Peptide {
+        // I/L-normalized, except in a build with Options::pack_sequences and without
+        // normalize_in_place, where it reads as in the fasta, std::hash and operator== of
+        // Hash.h treat I and L alike, so peptides compare the same either way
         const char* sequence;
         size_t sequence_length;
 
@@ -29,19 +38,127 @@ public:
                 size_t start_idx, size_t end_idx, double mass);
     };
 
-    enum class EnzymeType { Trypsin };
+    enum class EnzymeType { Trypsin, LysC, GluC };
+
+    // mass range of one shard, peptides in [core_min_mass, core_max_mass) belong to the shard,
+    // [min_mass, max_mass] adds the overlap margins and is what the shard is built with
+    struct Shard {
+        double core_min_mass;
+        double core_max_mass;
+        double min_mass;
+        double max_mass;
+    };
+
+    // what one build stage cost, stages are named after the builders they time
+    struct BuildStage {
+        std::string name;
+        double start_seconds;   // since the build began
+        double wall_seconds;
+        double cpu_seconds;     // process cpu time
+        size_t allocations;     // counted only in programs that define PPDATA_COUNT_ALLOCATIONS, see AllocationCounter.h
+        size_t bytes_allocated;
+        size_t buffer_bytes;    // size of the buffers the stage leaves behind, at their peak
+        size_t items_in;        // e.g. candidate peptides before mass filtering or before dedup
+        size_t items_out;
+    };
+
+    // stages in the order they ran
+    struct BuildReport {
+        std::vector<BuildStage> stages;
+
+        const BuildStage* stage(const char* name) const;  // nullptr if the stage did not run
+        void WriteJson(std::ostream& out) const;
+        void WriteChromeTrace(std::ostream& out) const;  // trace event format, for chrome://tracing or Perfetto
+    };
+
+    // build parameters
+    struct Options {
+        bool append_decoy = false;
+        EnzymeType enzyme_type = EnzymeType::Trypsin;
+        // digesting together with enzyme_type in the same pass, e.g. LysC or GluC for a
+        // Trypsin mixture, cleavage sites are those of any enzyme and missed cleavages are
+        // counted over all of them
+        std::vector<EnzymeType> additional_enzymes;
+        unsigned max_miss_cleavage = 0;
+        double min_mass = 600.0;
+        double max_mass = 5000.0;
+        size_t min_length = 0;  // residues
+        size_t max_length = 0;  // residues, 0 for no limit
+        // peptides for which filter(sequence, length, mass) is false are dropped before the
+        // dedup, sequence is I/L-normalized, may be called from several threads at once
+        std::function<bool(const char* sequence, size_t length, double mass)> filter;
+        unsigned thread_num = 0;  // digestion threads, 0 for all cores, the peptides do not depend on it
+        // keep the I/L-normalized protein sequences at 5 bits per residue instead of a byte,
+        // peptides are deduplicated on the packed words and their sequence then points into
+        // the protein sequence as read, with I not converted to L unless normalize_in_place,
+        // see Peptide::sequence
+        bool pack_sequences = false;
+        // convert I to L in the protein sequences while the fasta is read, peptides then point
+        // into them instead of into a normalized copy, which halves the sequence memory,
+        // Protein::sequence reads L for I, the flanking residues of peptides stay as read
+        bool normalize_in_place = false;
+    };
 
     // ctors
+    PPData(const char* filename, const Options& options);
     PPData(const char* filename, bool append_decoy, EnzymeType enzyme_type,
            unsigned max_miss_cleavage, double min_mass, double max_mass);
     PPData(const char* filename)
-           : PPData(filename, false, EnzymeType::Trypsin, 0, 600.0, 5000.0) {}
+           : PPData(filename, Options()) {}
     PPData(const PPData& ppdata);
+    // incremental build, digests of proteins unchanged since the build that wrote state_filename
+    // are reused, only added or changed proteins are digested, and state_filename is rewritten
+    // for the next release, the result is identical to a full build unless two protein sequences
+    // of the same length collide in both 64-bit hashes stored in the state, the state is reused
+    // across filters but not across other options, the incremental build digests on one thread
+    // and ignores thread_num and pack_sequences
+    PPData(const char* filename, const Options& options, const char* state_filename);
+    PPData(const char* filename, bool append_decoy, EnzymeType enzyme_type,
+           unsigned max_miss_cleavage, double min_mass, double max_mass, const char* state_filename);
+    // peptides of a table file written by BuildTable over the same fasta database, the table
+    // stays memory mapped and its peptides are only built when accessed with peptide()
+    PPData(const char* filename, bool append_decoy, const char* table_filename);
     ~PPData();
 
     // access methods
     size_t size() const;
+    // throws std::logic_error for peptides loaded from a table file, which have no object to refer to
     const Peptide& operator[](const size_t index) const;
+    // the same peptide by value, built from its record for a table file, for every build
+    Peptide peptide(const size_t index) const;
+    double mass(const size_t index) const;
+
+    // peptides are sorted by mass, return the index of the first peptide
+    // with mass not less than lower_mass / greater than upper_mass
+    size_t lower_bound(double lower_mass) const;
+    size_t upper_bound(double upper_mass) const;
+
+    const BuildReport& build_report() const;
+
+    // proteins by index in database order (the order of Peptide::protein), nullptr unless
+    // built with Options::pack_sequences, e.g. for FragmentGenerator
+    const PackedSequences* packed_sequences() const;
+
+    // out-of-core build for databases whose peptide pool does not fit in memory,
+    // digest in batches of at most memory_budget bytes, spill mass-sorted runs next to
+    // table_filename, and merge them into a deduplicated, mass-sorted table file,
+    // return the number of peptides in the table, the table records the digestion options
+    // but not the filter, and is built on one thread without pack_sequences
+    static size_t BuildTable(const char* filename, const Options& options,
+                             const char* table_filename, size_t memory_budget);
+    static size_t BuildTable(const char* filename, bool append_decoy, EnzymeType enzyme_type,
+                             unsigned max_miss_cleavage, double min_mass, double max_mass,
+                             const char* table_filename, size_t memory_budget);
+
+    // split [min_mass, max_mass] into shard_num ranges holding about the same number of peptides,
+    // each extended by margin on both sides for tolerance windows, a node then builds only its
+    // own shard by passing shard.min_mass and shard.max_mass to the ctor or BuildTable,
+    // options are those the shards are built with, peptides dropped by the filter are not counted
+    static std::vector<Shard> PlanShards(const char* filename, const Options& options,
+                                         unsigned shard_num, double margin);
+    static std::vector<Shard> PlanShards(const char* filename, bool append_decoy, EnzymeType enzyme_type,
+                                         unsigned max_miss_cleavage, double min_mass, double max_mass,
+                                         unsigned shard_num, double margin);
 
 private:
     class Impl;
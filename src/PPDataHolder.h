@@ -0,0 +1,154 @@
+// Copyright (C) 2016
+
+#pragma once
+
+#include "PPData.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+
+// holder of the current PPData for long-running services, a new database is built in the
+// background and published atomically, while readers keep the snapshot they acquired,
+// acquiring and releasing a snapshot is lock-free, old snapshots are freed with epochs:
+// a reader announces the global epoch in a slot before loading the current pointer, and a
+// retired snapshot is freed only when every announced epoch is newer than its retirement
+class PPDataHolder {
+public:
+    explicit PPDataHolder(std::unique_ptr<const PPData> initial)
+            : current_(initial.release()), slots_(kSlotNum) {
+        for (auto& slot : slots_) { slot.store(0); }
+    }
+    PPDataHolder(const PPDataHolder&) = delete;
+    PPDataHolder& operator=(const PPDataHolder&) = delete;
+    ~PPDataHolder() {  // all snapshots must have been released
+        if (builder_.joinable()) { builder_.join(); }
+        for (auto& retired : retired_) { delete retired.first; }
+        delete current_.load();
+    }
+
+    // read handle, keeps its snapshot alive until destruction
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& another) : slot_(another.slot_), ppdata_(another.ppdata_) {
+            another.slot_ = nullptr;
+            another.ppdata_ = nullptr;
+        }
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        ~Snapshot() { if (slot_ != nullptr) { slot_->store(0); } }
+
+        const PPData& operator*() const { return *ppdata_; }
+        const PPData* operator->() const { return ppdata_; }
+        const PPData* get() const { return ppdata_; }
+
+    private:
+        friend class PPDataHolder;
+        Snapshot(std::atomic<uint64_t>* slot, const PPData* ppdata) : slot_(slot), ppdata_(ppdata) {}
+
+        std::atomic<uint64_t>* slot_;
+        const PPData* ppdata_;
+    };
+
+    Snapshot Acquire() const {
+        auto epoch = epoch_.load();
+        auto start = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (size_t i = 0; ; ++i) {  // spins only when more than kSlotNum snapshots are alive
+            auto& slot = slots_[(start + i) % kSlotNum];
+            uint64_t expected = 0;
+            if (slot.load(std::memory_order_relaxed) == 0 && slot.compare_exchange_strong(expected, epoch)) {
+                return Snapshot(&slot, current_.load());
+            }
+            if (i % kSlotNum == kSlotNum - 1) {
+                std::this_thread::yield();
+                epoch = epoch_.load();
+            }
+        }
+    }
+
+    // swap in next, the previous snapshot is freed once no reader can see it
+    void Publish(std::unique_ptr<const PPData> next) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        auto previous = current_.exchange(next.release());
+        auto retire_epoch = epoch_.fetch_add(1);  // readers announcing a later epoch see next
+        retired_.push_back(std::make_pair(previous, retire_epoch));
+        ++version_;
+        ReclaimLocked();
+    }
+
+    // build in a background thread and publish when done, waits for a pending reload first
+    void Reload(std::function<std::unique_ptr<const PPData>()> build) {
+        Wait();
+        builder_ = std::thread([this, build]() {
+            try {
+                Publish(build());
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(writer_mutex_);
+                build_error_ = std::current_exception();
+            }
+        });
+    }
+    void Reload(const std::string& filename, bool append_decoy, PPData::EnzymeType enzyme_type,
+                unsigned max_miss_cleavage, double min_mass, double max_mass) {
+        Reload([=]() {
+            return std::unique_ptr<const PPData>(new PPData(filename.c_str(), append_decoy, enzyme_type,
+                                                            max_miss_cleavage, min_mass, max_mass));
+        });
+    }
+
+    // wait for the background build, rethrow its error if it failed
+    void Wait() {
+        if (builder_.joinable()) { builder_.join(); }
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        if (build_error_) {
+            auto error = build_error_;
+            build_error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    // free the retired snapshots no reader holds any more, return how many are still pending
+    size_t Reclaim() {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        ReclaimLocked();
+        return retired_.size();
+    }
+
+    // number of publishes so far
+    uint64_t version() const { return version_.load(); }
+
+private:
+    enum : size_t { kSlotNum = 256 };  // max snapshots held at the same time without spinning
+
+    std::atomic<const PPData*> current_;
+    std::atomic<uint64_t> epoch_{ 1 };  // slot value 0 means free
+    mutable std::vector<std::atomic<uint64_t>> slots_;
+    std::atomic<uint64_t> version_{ 0 };
+
+    std::mutex writer_mutex_;
+    std::vector<std::pair<const PPData*, uint64_t>> retired_;  // snapshot and the epoch it retired in
+    std::thread builder_;
+    std::exception_ptr build_error_;
+
+    void ReclaimLocked() {
+        auto min_epoch = UINT64_MAX;
+        for (auto& slot : slots_) {
+            auto epoch = slot.load();
+            if (epoch != 0 && epoch < min_epoch) { min_epoch = epoch; }
+        }
+        auto kept = retired_.begin();
+        for (auto& retired : retired_) {
+            if (retired.second < min_epoch) { delete retired.first; }
+            else { *kept++ = retired; }
+        }
+        retired_.erase(kept, retired_.end());
+    }
+};
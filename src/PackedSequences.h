@@ -0,0 +1,168 @@
+#pragma once
+
+#include "PPData.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// I/L-normalized sequences at 5 bits per residue, 12 residues per 64-bit word and every
+// sequence starting on a word, codes 1..26 are 'A'..'Z' with I coded as L, 31 is any
+// other character and 0 pads the last word of a sequence, 12 residues from any offset
+// are one shift of two words, so peptides are hashed and compared 12 residues a step,
+// or 24 with SSE2, which shifts the two windows of three words in one register
+class PackedSequences {
+public:
+    enum : size_t { kBits = 5, kResiduesPerWord = 12 };
+    enum : uint64_t { kCodeMask = 31, kWindowMask = (uint64_t(1) << 60) - 1 };
+
+    PackedSequences() : words_(1, 0) {}  // a zero word after the last sequence, for Window
+
+    void Reserve(size_t residue_num, size_t sequence_num) {
+        words_.reserve(residue_num / kResiduesPerWord + sequence_num + 1);
+        starts_.reserve(sequence_num);
+        lengths_.reserve(sequence_num);
+    }
+
+    // return the index of the sequence
+    size_t Add(const char* sequence, size_t length) {
+        words_.pop_back();
+        starts_.push_back(words_.size());
+        lengths_.push_back(length);
+        for (size_t i = 0; i < length; i += kResiduesPerWord) {
+            uint64_t word = 0;
+            auto end = i + kResiduesPerWord < length ? i + kResiduesPerWord : length;
+            for (auto j = i; j < end; ++j) { word |= Code(sequence[j]) << ((j - i) * kBits); }
+            words_.push_back(word);
+        }
+        words_.push_back(0);
+        return starts_.size() - 1;
+    }
+
+    size_t size() const { return starts_.size(); }
+    size_t length(size_t index) const { return lengths_[index]; }
+    size_t memory_bytes() const {
+        return words_.capacity() * sizeof(uint64_t) + starts_.capacity() * sizeof(size_t)
+               + lengths_.capacity() * sizeof(size_t);
+    }
+
+    static uint64_t Code(char residue) {
+        auto c = static_cast<unsigned char>(residue);
+        if (c == 'I') { c = 'L'; }
+        return c >= 'A' && c <= 'Z' ? uint64_t(c - 'A' + 1) : uint64_t(kCodeMask);
+    }
+    static char Residue(uint64_t code) { return "\0ABCDEFGHIJKLMNOPQRSTUVWXYZ?????"[code]; }
+
+    // code of residue offset of sequence index
+    uint64_t CodeAt(size_t index, size_t offset) const {
+        auto word = words_[starts_[index] + offset / kResiduesPerWord];
+        return (word >> (offset % kResiduesPerWord * kBits)) & kCodeMask;
+    }
+
+    // residues [offset, offset + 12) of sequence index, beyond the sequence end they are 0
+    // or belong to the next sequence, callers mask them
+    uint64_t Window(size_t index, size_t offset) const {
+        auto word = starts_[index] + offset / kResiduesPerWord;
+        auto shift = offset % kResiduesPerWord * kBits;
+        return ((words_[word] >> shift) | (words_[word + 1] << (60 - shift))) & kWindowMask;
+    }
+
+    // write length residues from offset into out, I comes out as L
+    void Unpack(size_t index, size_t offset, size_t length, char* out) const {
+        for (size_t i = 0; i < length; i += kResiduesPerWord) {
+            auto window = Window(index, offset + i);
+            auto end = i + kResiduesPerWord < length ? i + kResiduesPerWord : length;
+            for (auto j = i; j < end; ++j) {
+                out[j] = Residue(window & kCodeMask);
+                window >>= kBits;
+            }
+        }
+    }
+
+    uint64_t Hash(size_t index, size_t offset, size_t length) const {
+        uint64_t hash = 0x9e3779b97f4a7c15ull ^ length;
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 2 * kResiduesPerWord <= length; i += 2 * kResiduesPerWord) {
+            uint64_t windows[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(windows), WindowPair(index, offset + i));
+            for (auto window : windows) {
+                hash = (hash ^ window) * 0xff51afd7ed558ccdull;
+                hash ^= hash >> 32;
+            }
+        }
+#endif
+        for (; i + kResiduesPerWord <= length; i += kResiduesPerWord) {
+            hash = (hash ^ Window(index, offset + i)) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 32;
+        }
+        if (i < length) {
+            hash = (hash ^ (Window(index, offset + i) & TailMask(length - i))) * 0xc4ceb9fe1a85ec53ull;
+        }
+        return hash ^ (hash >> 29);
+    }
+
+    // residues [offset, offset + length) of one sequence against those of another
+    bool Equal(size_t index, size_t offset, size_t other_index, size_t other_offset, size_t length) const {
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 2 * kResiduesPerWord <= length; i += 2 * kResiduesPerWord) {
+            auto equal = _mm_cmpeq_epi8(WindowPair(index, offset + i), WindowPair(other_index, other_offset + i));
+            if (_mm_movemask_epi8(equal) != 0xffff) { return false; }
+        }
+#endif
+        for (; i + kResiduesPerWord <= length; i += kResiduesPerWord) {
+            if (Window(index, offset + i) != Window(other_index, other_offset + i)) { return false; }
+        }
+        return i == length
+               || ((Window(index, offset + i) ^ Window(other_index, other_offset + i)) & TailMask(length - i)) == 0;
+    }
+
+private:
+    std::vector<uint64_t> words_;
+    std::vector<size_t> starts_;  // first word of each sequence
+    std::vector<size_t> lengths_;
+
+    static uint64_t TailMask(size_t residue_num) { return (uint64_t(1) << (residue_num * kBits)) - 1; }
+
+#ifdef __SSE2__
+    // Window of offset and of offset + 12 in the two lanes, both windows shift their words
+    // by the same count, so three words are shifted and merged as two pairs at once
+    __m128i WindowPair(size_t index, size_t offset) const {
+        auto word = &words_[starts_[index] + offset / kResiduesPerWord];
+        auto shift = static_cast<int>(offset % kResiduesPerWord * kBits);
+        auto low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word));
+        auto high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word + 1));
+        auto window = _mm_or_si128(_mm_srl_epi64(low, _mm_cvtsi32_si128(shift)),
+                                   _mm_sll_epi64(high, _mm_cvtsi32_si128(60 - shift)));
+        return _mm_and_si128(window, _mm_set1_epi64x(static_cast<long long>(kWindowMask)));
+    }
+#endif
+};
+
+// dedup key of peptides over packed proteins, in the order of their PPData::Protein
+// (stored contiguously), for PeptideSet and ConcurrentPeptideSet
+class PackedPeptideKey {
+public:
+    using Peptide = PPData::Peptide;
+
+    PackedPeptideKey(const PackedSequences& packed, const PPData::Protein* first_protein)
+            : packed_(&packed), first_protein_(first_protein) {}
+
+    uint32_t Hash(const Peptide& peptide) const {
+        auto hash = packed_->Hash(Index(peptide), peptide.offset, peptide.sequence_length);
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+    bool Equal(const Peptide& one, const Peptide& another) const {
+        return one.sequence_length == another.sequence_length
+               && packed_->Equal(Index(one), one.offset, Index(another), another.offset, one.sequence_length);
+    }
+
+private:
+    const PackedSequences* packed_;
+    const PPData::Protein* first_protein_;
+
+    size_t Index(const Peptide& peptide) const { return static_cast<size_t>(peptide.protein - first_protein_); }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// fast parsers for numbers in text spectrum formats, they stop at the first character
+// that cannot continue the number and return the position after it, or nullptr when
+// no number starts at p
+
+inline const char* ParseDouble(const char* p, const char* end, double& value) {
+    static const double kPow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) { negative = *p++ == '-'; }
+
+    // up to 18 significant digits go into the mantissa, the rest only shift the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    for (; p < end && unsigned(*p - '0') < 10; ++p) {
+        any_digit = true;
+        if (mantissa < 100000000000000000ull) { mantissa = mantissa * 10 + (*p - '0'); }
+        else { ++exponent; }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && unsigned(*p - '0') < 10; ++p) {
+            any_digit = true;
+            if (mantissa < 100000000000000000ull) {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+        }
+    }
+    if (!any_digit) { return nullptr; }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        auto q = p + 1;
+        bool negative_exponent = false;
+        if (q < end && (*q == '-' || *q == '+')) { negative_exponent = *q++ == '-'; }
+        if (q < end && unsigned(*q - '0') < 10) {
+            int e = 0;
+            for (; q < end && unsigned(*q - '0') < 10; ++q) { e = e < 10000 ? e * 10 + (*q - '0') : e; }
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+
+    // exact when the mantissa fits in 53 bits and the power of ten is exact
+    auto result = static_cast<double>(mantissa);
+    if (exponent < 0) { result = -exponent <= 22 ? result / kPow10[-exponent] : result * std::pow(10.0, exponent); }
+    else if (exponent > 0) { result = exponent <= 22 ? result * kPow10[exponent] : result * std::pow(10.0, exponent); }
+    value = negative ? -result : result;
+    return p;
+}
+
+inline const char* ParseUnsigned(const char* p, const char* end, unsigned& value) {
+    if (p >= end || unsigned(*p - '0') >= 10) { return nullptr; }
+    unsigned result = 0;
+    for (; p < end && unsigned(*p - '0') < 10; ++p) { result = result * 10 + (*p - '0'); }
+    value = result;
+    return p;
+}
@@ -2,175 +2,411 @@
 
 #include "PPData.h"
 #include "ProtData.h"
+#include "Digester.h"
+#include "PeptTable.h"
+#include "BuildState.h"
+#include "BuildRecorder.h"
 #include "Hash.h"  // hash support for PPData::Peptide
+#include "PeptideSet.h"
+#include "ConcurrentPeptideSet.h"
+#include "PackedSequences.h"
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
 #include <numeric>
-#include <unordered_set>
-#include <algorithm>
 #include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
 
 class PeptData {
 public:
     using Protein = PPData::Protein;
     using Peptide = PPData::Peptide;
     using EnzymeType = PPData::EnzymeType;
+    using DigestRecord = BuildState::DigestRecord;
 
     // TODO: provide an API for assigning a different mass table (possibly with modifications)
     PeptData(const ProtData& proteins, EnzymeType enzyme_type, unsigned max_miss_cleavage,
              double min_mass, double max_mass)
-            : enzyme_type_(enzyme_type), max_miss_cleavage_(max_miss_cleavage),
-              min_mass_(min_mass), max_mass_(max_mass) {
-        // calculate compact size
-        auto sequences_len_sum = std::accumulate(proteins.begin(), proteins.end(), 0,
-            [](const int& sum, const Protein& protein) {
-                return sum + protein.sequence_length;
-            }
-        );
-        auto compact_size = sequences_len_sum + proteins.size();  // append '\0' at the end of each sequence
-        compact_sequences_.resize(compact_size);
+            : PeptData(proteins, MakeOptions(enzyme_type, max_miss_cleavage, min_mass, max_mass)) {}
 
-        // build compact sequences and peptides
-        std::unordered_set<Peptide> pool;
-        int index = 0;
-        for (auto& protein : proteins) {
-            // fill compact sequence
-            const char* compact_sequence = &compact_sequences_[index];
-            for (unsigned i = 0; i < protein.sequence_length; ++i) {
-                compact_sequences_[index++] = protein.sequence[i] == 'I' ? 'L' : protein.sequence[i];
-            }  // prefer L
-            compact_sequences_[index++] = '\0';
+    // build peptides into a pool and sort them, sequences are copied with I converted to L,
+    // packed, or used as they are when proteins are normalized already
+    PeptData(const ProtData& proteins, const PPData::Options& options, BuildRecorder* recorder = nullptr)
+            : digester_(EnzymeMask(options), options.max_miss_cleavage, options.min_mass, options.max_mass,
+                        options.min_length, options.max_length),
+              filter_(options.filter) {
+        std::vector<Peptide> peptides;
+        if (options.pack_sequences) {
+            PackSequences(proteins, recorder);
+            auto first_protein = proteins.size() > 0 ? &proteins[0] : nullptr;
+            peptides = DigestAll(proteins, PackedPeptideKey(*packed_, first_protein), options.thread_num, recorder);
+        }
+        else {
+            BuildCompactSequences(proteins, recorder);
+            peptides = DigestAll(proteins, SequenceKey(), options.thread_num, recorder);
+        }
+        BuildPeptides(std::move(peptides), recorder);
+        RestoreFlanks(proteins);
+    }
+
+    // incremental build, proteins whose sequence is found in the previous state reuse its
+    // digests instead of being digested again, pool insertions happen in the same order
+    // as in a full build so the result is identical unless two sequences of the same length
+    // collide in both 64-bit hashes, state is replaced by this build's state, the state keeps
+    // the digests before options.filter so that it does not depend on the filter, digestion
+    // runs on one thread and options.thread_num and pack_sequences are not used
+    PeptData(const ProtData& proteins, EnzymeType enzyme_type, unsigned max_miss_cleavage,
+             double min_mass, double max_mass, BuildState& state, BuildRecorder* recorder = nullptr,
+             size_t min_length = 0, size_t max_length = 0)
+            : PeptData(proteins, MakeOptions(enzyme_type, max_miss_cleavage, min_mass, max_mass,
+                                             min_length, max_length), state, recorder) {}
+    PeptData(const ProtData& proteins, const PPData::Options& options, BuildState& state,
+             BuildRecorder* recorder = nullptr)
+            : digester_(EnzymeMask(options), options.max_miss_cleavage, options.min_mass, options.max_mass,
+                        options.min_length, options.max_length),
+              filter_(options.filter) {
+        BuildCompactSequences(proteins, recorder);
+        BuildStageTimer timer(recorder, "DigestIncremental");  // digestion and dedup, reused or not
+
+        std::unordered_multimap<uint64_t, size_t> previous;  // sequence hash to protein in state
+        if (state.Compatible(digester_)) {
+            for (size_t i = 0; i < state.size(); ++i) { previous.emplace(state[i].hash, i); }
+        }
+
+        BuildState next(digester_);
+        PeptideSet pool(digester_.EstimateDigestNum(ResidueNum(proteins), proteins.size()));
+        for (unsigned i = 0; i < proteins.size(); ++i) {
+            auto& protein = proteins[i];
+            auto compact_sequence = compact_starts_[i];
+            auto hash = BuildState::Hash(protein.sequence, protein.sequence_length);
+            auto check = BuildState::Check(protein.sequence, protein.sequence_length);
+            next.AddProtein(hash, check, protein.sequence_length);
 
-            // digest and build peptides into pool
-            Digest(pool, protein, compact_sequence);
+            auto range = previous.equal_range(hash);
+            auto match = std::find_if(range.first, range.second, [&](const auto& entry) {
+                return state[entry.second].sequence_length == protein.sequence_length
+                       && state[entry.second].check == check;
+            });
+            if (match != range.second) {  // unchanged protein
+                auto digests = state.digests(match->second);
+                for (unsigned j = 0; j < state[match->second].digest_num; ++j) {
+                    auto& digest = digests[j];
+                    if (Keep(compact_sequence + digest.offset, digest.length, digest.mass)) {
+                        pool.Insert(Peptide(protein, compact_sequence, digest.offset,
+                                            digest.offset + digest.length, digest.mass));
+                    }
+                    next.AddDigest(digest.offset, digest.offset + digest.length, digest.mass);
+                }
+                next.CountReused();
+            }
+            else {  // added or changed protein
+                digester_.Digest(compact_sequence, protein.sequence_length,
+                    [&](size_t start, size_t end, double mass) {
+                        if (Keep(compact_sequence + start, end - start, mass)) {
+                            pool.Insert(Peptide(protein, compact_sequence, start, end, mass));
+                        }
+                        next.AddDigest(start, end, mass);
+                    }
+                );
+                next.CountDigested();
+            }
         }
+        timer.Stop(proteins.size(), pool.size(), pool.memory_bytes());
+        BuildPeptides(pool.Release(), recorder);
+        RestoreFlanks(proteins);
+        state = std::move(next);
+    }
 
-        peptides_.insert(peptides_.end(), pool.begin(), pool.end());
-        std::stable_sort(peptides_.begin(), peptides_.end(),
-                  [](const auto& one, const auto& another) { return one.mass < another.mass; });
+    // peptides of a table file built out-of-core over the same proteins, the records stay in
+    // the mapped file, which the copies share, and peptides are built from them on access
+    PeptData(const ProtData& proteins, std::shared_ptr<const PeptTable> table, BuildRecorder* recorder = nullptr)
+            : digester_(table->header().enzyme_mask, table->header().max_miss_cleavage,
+                        table->header().min_mass, table->header().max_mass,
+                        static_cast<size_t>(table->header().min_length),
+                        static_cast<size_t>(table->header().max_length)),
+              table_(std::move(table)) {
+        if (table_->header().protein_num != proteins.size()
+                || table_->header().append_decoy != (proteins.append_decoy() ? 1u : 0u)) {
+            throw std::runtime_error("Peptide table does not match the protein database.");
+        }
+        BuildCompactSequences(proteins, recorder);
     }
 
-    size_t size() const { return peptides_.size(); }
-    const Peptide& operator[](const size_t index) const { return peptides_[index]; }
+    size_t size() const { return table_ ? table_->size() : peptides_.size(); }
+    const PackedSequences* packed_sequences() const { return packed_.get(); }
+    bool mapped() const { return table_ != nullptr; }
 
-    auto begin() const { return peptides_.cbegin(); }
-    auto end() const { return peptides_.cend(); }
+    // peptides of a mapped table have no object to refer to, they are read with Get
+    const Peptide& operator[](const size_t index) const {
+        if (table_) { throw std::logic_error("Peptides of a mapped table are built on access, see PPData::peptide."); }
+        return peptides_[index];
+    }
+    Peptide Get(const ProtData& proteins, const size_t index) const {
+        if (!table_) { return peptides_[index]; }
+        auto& record = (*table_)[index];
+        return Peptide(proteins[record.protein], compact_starts_[record.protein],
+                       record.offset, record.offset + record.length, record.mass);
+    }
+    double mass(const size_t index) const { return table_ ? (*table_)[index].mass : peptides_[index].mass; }
 
-    auto lower_bound(double lower_mass) const {
+    // index of the first peptide of mass not less than lower_mass / greater than upper_mass
+    size_t lower_bound(double lower_mass) const {
+        if (table_) { return static_cast<size_t>(table_->lower_bound(lower_mass) - table_->begin()); }
         auto start = std::lower_bound(peptides_.begin(), peptides_.end(), lower_mass,
             [](const auto& peptide, const auto& val) {
                 return peptide.mass < val;
             }
         );
-        return start;
+        return static_cast<size_t>(start - peptides_.begin());
     }
-    auto upper_bound(double upper_mass) const {
+    size_t upper_bound(double upper_mass) const {
+        if (table_) { return static_cast<size_t>(table_->upper_bound(upper_mass) - table_->begin()); }
         auto end = std::upper_bound(peptides_.begin(), peptides_.end(), upper_mass,
             [](const auto& val, const auto& peptide) {
                 return val < peptide.mass;
             }
         );
-        return end;
+        return static_cast<size_t>(end - peptides_.begin());
     }
 
 private:
-    const EnzymeType enzyme_type_;
-    const unsigned max_miss_cleavage_;
-    const double min_mass_;
-    const double max_mass_;
+    const Digester digester_;
+    const std::function<bool(const char*, size_t, double)> filter_;  // empty for none
 
-    std::vector<char> compact_sequences_;  // after convert IL
+    std::shared_ptr<const PackedSequences> packed_;  // instead of compact_sequences_, shared by copies
+    std::vector<char> compact_sequences_;  // after convert IL, empty if proteins are normalized
+    std::vector<const char*> compact_starts_;  // compact sequence of each protein
+    bool as_read_ = false;  // compact_starts_ point to sequences as read, I not converted to L
     std::vector<Peptide> peptides_;
-
-    // internal mass table
-    const double proton_ = 1.00727;  // we don't use proton_ here
-    const double hydrogen_ = 1.00782;
-    const double oxygen_ = 15.99491;
-    const double water_ = oxygen_ + hydrogen_ + hydrogen_;
-
-    const std::unordered_map<char, double> mass_table_ = {
-        { 'G', 57.02147 },{ 'A', 71.03712 },{ 'S', 87.03203 },{ 'P', 97.05277 },
-        { 'V', 99.06842 },{ 'T', 101.04768 },{ 'C', 103.00919 + 57.021464 /* Fixed Mod on C */ },
-        /*{ 'I', 113.08407 },*/ { 'L', 113.08407 },
-        { 'N', 114.04293 },{ 'D', 115.02695 },{ 'Q', 128.05858 },
-        { 'K', 128.09497 },{ 'E', 129.04260 },{ 'M', 131.04049 },{ 'H', 137.05891 },
-        { 'F', 147.06842 },{ 'R', 156.10112 },{ 'Y', 163.06333 },{ 'W', 186.07932 }
-    };
+    std::shared_ptr<const PeptTable> table_;  // instead of peptides_ for a loaded table
 
     // builders
-    void Digest(std::unordered_set<Peptide>& pool,
-                const Protein& protein, const char* compact_sequence) const {
-        auto cleavage_sites = GenCleavageSites(compact_sequence, protein.sequence_length);
-        auto segments_mass = SegmentsMass(compact_sequence, protein.sequence_length, cleavage_sites);  // if segment equals to 0, then we ignore it
-        auto local_max_miss_cleavage = cleavage_sites.size() - 1 < max_miss_cleavage_
-                                       ? cleavage_sites.size() - 1 : max_miss_cleavage_;
-
-        // handle miss cleavage, put smaller loop inside to accelerate the computation
-        for (unsigned index = 0; index < cleavage_sites.size(); ++index) {
-            for (unsigned miss_cleavage = 0; miss_cleavage <= local_max_miss_cleavage; ++miss_cleavage) {
-                auto start = cleavage_sites[index];
-                auto end = index + miss_cleavage + 1 < cleavage_sites.size()
-                           ? cleavage_sites[index + miss_cleavage + 1]
-                           : protein.sequence_length;  // next char of the end
-
-                auto mass = water_;
-                for (unsigned i = 0; i < miss_cleavage + 1; ++i) {
-                    auto local_mass = segments_mass[index + i];
-                    mass += local_mass;
-                    if (local_mass == 0) {
-                        mass = 0;  // if some mass equals to zero, ignore it
-                        break;
-                    }
-                }
-                if (mass == 0 /* contain intractable amino acid */
-                        || mass < min_mass_ || max_mass_ < mass /* mass ourside range */) {
-                    if (end == protein.sequence_length) { break; }
-                    else { continue; }
+    static size_t ResidueNum(const ProtData& proteins) {
+        return std::accumulate(proteins.begin(), proteins.end(), size_t(0),
+            [](const size_t& sum, const Protein& protein) {
+                return sum + protein.sequence_length;
+            }
+        );
+    }
+
+    // packed copy for dedup, digestion runs over the sequences as read, I and L having
+    // the same mass and no role in cleavage
+    void PackSequences(const ProtData& proteins, BuildRecorder* recorder) {
+        BuildStageTimer timer(recorder, "PackSequences");
+        auto packed = std::make_shared<PackedSequences>();
+        auto residue_num = ResidueNum(proteins);
+        packed->Reserve(residue_num, proteins.size());
+        compact_starts_.reserve(proteins.size());
+        for (auto& protein : proteins) {
+            packed->Add(protein.sequence, protein.sequence_length);
+            compact_starts_.push_back(protein.sequence);
+        }
+        as_read_ = !proteins.normalized();
+        packed_ = packed;
+        timer.Stop(proteins.size(), residue_num, packed_->memory_bytes() + compact_starts_.capacity() * sizeof(const char*));
+    }
+
+    void BuildCompactSequences(const ProtData& proteins, BuildRecorder* recorder = nullptr) {
+        if (proteins.normalized()) {  // nothing to copy, peptides point into the proteins
+            compact_starts_.reserve(proteins.size());
+            for (auto& protein : proteins) { compact_starts_.push_back(protein.sequence); }
+            return;
+        }
+        BuildStageTimer timer(recorder, "BuildCompactSequences");
+        // calculate compact size
+        auto sequences_len_sum = ResidueNum(proteins);
+        auto compact_size = sequences_len_sum + proteins.size();  // append '\0' at the end of each sequence
+        compact_sequences_.resize(compact_size);
+        compact_starts_.reserve(proteins.size());
+
+        size_t index = 0;
+        for (auto& protein : proteins) {
+            compact_starts_.push_back(&compact_sequences_[index]);
+            for (unsigned i = 0; i < protein.sequence_length; ++i) {
+                compact_sequences_[index++] = protein.sequence[i] == 'I' ? 'L' : protein.sequence[i];
+            }  // prefer L
+            compact_sequences_[index++] = '\0';
+        }
+        timer.Stop(proteins.size(), compact_size,
+                   compact_sequences_.capacity() + compact_starts_.capacity() * sizeof(const char*));
+    }
+
+    // digestion and insertion alternate protein by protein, so each is timed on its own
+    // and they are reported as if run one after the other, with several threads, each
+    // digests chunks of proteins into a shared concurrent pool
+    template <typename Key>
+    std::vector<Peptide> DigestAll(const ProtData& proteins, const Key& key, unsigned requested_thread_num,
+                                   BuildRecorder* recorder) const {
+        auto expected_num = digester_.EstimateDigestNum(ResidueNum(proteins), proteins.size());
+        auto thread_num = ThreadNum(requested_thread_num, proteins.size());
+        auto begin = BuildRecorder::Now();
+        std::vector<DigestCounts> counts(thread_num);
+        std::vector<Peptide> peptides;
+        size_t pool_bytes = 0;
+        if (thread_num == 1) {
+            BasicPeptideSet<Key> pool(expected_num, key);
+            DigestProteins(proteins, 0, proteins.size(), pool, counts[0]);
+            pool_bytes = pool.memory_bytes();
+            peptides = pool.Release();
+        }
+        else {
+            BasicConcurrentPeptideSet<Key> pool(expected_num, thread_num, key);
+            std::atomic<size_t> next_chunk(0);
+            auto work = [&](unsigned thread_id) {
+                for (auto first = next_chunk++ * kChunkSize; first < proteins.size(); first = next_chunk++ * kChunkSize) {
+                    DigestProteins(proteins, first, std::min<size_t>(first + kChunkSize, proteins.size()),
+                                   pool, counts[thread_id]);
                 }
+            };
+            std::vector<std::thread> threads;
+            for (unsigned i = 1; i < thread_num; ++i) { threads.emplace_back(work, i); }
+            work(0);
+            for (auto& thread : threads) { thread.join(); }
+            pool_bytes = pool.memory_bytes();
+            peptides = pool.Release();
+        }
+        if (recorder) { RecordDigestStages(*recorder, begin, BuildRecorder::Now(), counts, peptides.size(), pool_bytes); }
+        return peptides;
+    }
+
+    enum : size_t { kChunkSize = 64 };  // proteins a thread takes at a time
 
-                pool.insert(Peptide(protein, compact_sequence, start, end, mass));
-                if (end == protein.sequence_length) { break; }  // break the small loop
+    // digestion work of one thread
+    struct DigestCounts {
+        size_t digest_num = 0;
+        size_t filtered_num = 0;
+        BuildRecorder::Clock::duration digest_wall{};
+        size_t digest_allocations = 0;
+        size_t digest_bytes = 0;
+    };
+
+    static PPData::Options MakeOptions(EnzymeType enzyme_type, unsigned max_miss_cleavage,
+                                       double min_mass, double max_mass,
+                                       size_t min_length = 0, size_t max_length = 0) {
+        PPData::Options options;
+        options.enzyme_type = enzyme_type;
+        options.max_miss_cleavage = max_miss_cleavage;
+        options.min_mass = min_mass;
+        options.max_mass = max_mass;
+        options.min_length = min_length;
+        options.max_length = max_length;
+        options.thread_num = 1;
+        return options;
+    }
+
+
+    static unsigned ThreadNum(unsigned requested, size_t protein_num) {
+        auto thread_num = requested != 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+        auto chunk_num = (protein_num + kChunkSize - 1) / kChunkSize;
+        return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(thread_num, chunk_num)));
+    }
+
+    // proteins [first, last) into pool, a PeptideSet or a ConcurrentPeptideSet
+    template <typename Pool>
+    void DigestProteins(const ProtData& proteins, size_t first, size_t last, Pool& pool, DigestCounts& counts) const {
+        std::vector<DigestRecord> digests;  // of one protein
+        for (auto i = first; i < last; ++i) {
+            // no cpu clock here, reading it is a system call
+            auto wall = BuildRecorder::Clock::now();
+            auto allocations = AllocationCounter::count();
+            auto bytes = AllocationCounter::bytes();
+            Digest(digests, proteins[i], compact_starts_[i], counts.filtered_num);
+            counts.digest_wall += BuildRecorder::Clock::now() - wall;
+            counts.digest_allocations += AllocationCounter::count() - allocations;
+            counts.digest_bytes += AllocationCounter::bytes() - bytes;
+
+            for (auto& digest : digests) {
+                pool.Insert(Peptide(proteins[i], compact_starts_[i], digest.offset,
+                                    digest.offset + digest.length, digest.mass));
             }
+            counts.digest_num += digests.size();
         }
     }
 
-    std::vector<unsigned> GenCleavageSites(const char* compact_sequence, size_t sequence_length) const {
-        std::vector<unsigned> cleavage_sites;
-        cleavage_sites.push_back(0);
-        switch (enzyme_type_) {  // to support more enzymes, simply add different cleavage rules here
-        case EnzymeType::Trypsin:  // Trypsin KR
-            for (unsigned index = 1; index < sequence_length; ++index) {
-                if ((compact_sequence[index - 1] == 'K' || compact_sequence[index - 1] == 'R')
-                    && compact_sequence[index] != 'P') {
-                    cleavage_sites.push_back(index);
-                }
+    // by mass, ties by protein, offset and length, which is the order a serial build
+    // inserts distinct peptides in, so any number of threads gives the same table
+    void BuildPeptides(std::vector<Peptide>&& peptides, BuildRecorder* recorder = nullptr) {
+        BuildStageTimer timer(recorder, "Sort");
+        peptides_ = std::move(peptides);
+        std::sort(peptides_.begin(), peptides_.end(), [](const auto& one, const auto& another) {
+            if (one.mass != another.mass) { return one.mass < another.mass; }
+            if (one.protein != another.protein) { return one.protein < another.protein; }
+            if (one.offset != another.offset) { return one.offset < another.offset; }
+            return one.sequence_length < another.sequence_length;
+        });
+        timer.Stop(peptides_.size(), peptides_.size(), peptides_.capacity() * sizeof(Peptide));
+    }
+
+    // flanking residues are read from the protein sequences, which read L for an I when
+    // normalized, so they are looked up as read from the fasta
+    void RestoreFlanks(const ProtData& proteins) {
+        if (!proteins.normalized()) { return; }
+        for (auto& peptide : peptides_) {
+            if (peptide.n_term == 'L') { peptide.n_term = proteins.OriginalResidue(*peptide.protein, peptide.offset - 1); }
+            if (peptide.c_term == 'L') {
+                peptide.c_term = proteins.OriginalResidue(*peptide.protein, peptide.offset + peptide.sequence_length);
             }
-            break;
-        default:
-            throw std::runtime_error("Enzyme type is not supported.");
         }
-        return cleavage_sites;
-    }
-
-    // return the mass value in each segment, so that we don't have to re-compute them
-    std::vector<double> SegmentsMass(const char* sequence, size_t sequence_length,
-                                     const std::vector<unsigned>& cleavage_sites) const {
-        std::vector<double> segments_mass;
-        for (unsigned i = 0; i < cleavage_sites.size(); ++i) {
-            auto start = cleavage_sites[i];
-            auto end = i == cleavage_sites.size() - 1
-                       ? sequence_length
-                       : cleavage_sites[i + 1];
-            double segment = 0;
-            try {
-                for (auto j = start; j < end; ++j) {
-                    segment += mass_table_.at(sequence[j]);  // will throw an exception if no such character in table
+    }
+
+    void Digest(std::vector<DigestRecord>& digests, const Protein& protein,
+                const char* compact_sequence, size_t& filtered_num) const {
+        digests.clear();
+        digester_.Digest(compact_sequence, protein.sequence_length,
+            [&](size_t start, size_t end, double mass) {
+                if (filter_ && !filter_(FilterView(compact_sequence + start, end - start), end - start, mass)) {
+                    ++filtered_num;
+                    return;
                 }
-            }
-            catch (std::out_of_range e) {
-                segment = 0;  // if there is an error, the segment equals to 0
-            }
-            segments_mass.push_back(segment);
+                digests.push_back(DigestRecord{ static_cast<uint32_t>(start), static_cast<uint32_t>(end - start), mass });
+            },
+            &filtered_num
+        );
+    }
+
+    // for the incremental build, whose compact sequences are normalized
+    bool Keep(const char* compact_sequence, size_t length, double mass) const {
+        return !filter_ || filter_(compact_sequence, length, mass);
+    }
+
+    // the filter is promised I/L-normalized sequences, a peptide of sequences as read is
+    // converted into a per-thread buffer
+    const char* FilterView(const char* sequence, size_t length) const {
+        if (!as_read_) { return sequence; }
+        thread_local std::vector<char> normalized;
+        normalized.resize(length);
+        std::replace_copy(sequence, sequence + length, normalized.begin(), 'I', 'L');
+        return normalized.data();
+    }
+
+    // the digest stage turns candidate peptides into the ones within the mass range, the
+    // dedup stage those into distinct peptides, cpu time is split in proportion to wall
+    // time, with several threads the digest wall time is the mean of the threads
+    static void RecordDigestStages(BuildRecorder& recorder, const BuildRecorder::Mark& begin,
+                                   const BuildRecorder::Mark& end, const std::vector<DigestCounts>& counts,
+                                   size_t distinct_num, size_t pool_bytes) {
+        DigestCounts total;
+        for (auto& thread_counts : counts) {
+            total.digest_num += thread_counts.digest_num;
+            total.filtered_num += thread_counts.filtered_num;
+            total.digest_wall += thread_counts.digest_wall;
+            total.digest_allocations += thread_counts.digest_allocations;
+            total.digest_bytes += thread_counts.digest_bytes;
         }
-        return segments_mass;
+        auto digest_wall = total.digest_wall / static_cast<long>(counts.size());
+        auto split = end;
+        split.wall = begin.wall + digest_wall;
+        auto total_wall = (end.wall - begin.wall).count();
+        auto share = total_wall > 0 ? std::min(1.0, static_cast<double>(digest_wall.count()) / total_wall) : 1.0;
+        split.cpu = begin.cpu + static_cast<std::clock_t>((end.cpu - begin.cpu) * share);
+        // other threads allocating while one digests are counted too, keep the split within the range
+        split.allocations = std::min(end.allocations, begin.allocations + total.digest_allocations);
+        split.bytes_allocated = std::min(end.bytes_allocated, begin.bytes_allocated + total.digest_bytes);
+
+        auto& digest = recorder.Add("Digest", begin, split, total.digest_num + total.filtered_num, total.digest_num, 0);
+        digest.wall_seconds = std::chrono::duration<double>(digest_wall).count();
+        recorder.Add("Dedup", split, end, total.digest_num, distinct_num, pool_bytes);
     }
 };
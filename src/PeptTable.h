@@ -0,0 +1,108 @@
+#pragma once
+
+#include "PPData.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+// on-disk peptide table, a header followed by mass-sorted fixed-size records,
+// so that the table can be memory mapped and searched without parsing
+struct PeptRecord {
+    uint32_t protein;  // index in ProtData
+    uint32_t offset;  // offset in protein sequence
+    uint32_t length;
+    uint32_t reserved;
+    double mass;
+};
+static_assert(sizeof(PeptRecord) == 24, "PeptRecord must be packed for the on-disk layout");
+
+struct PeptTableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t enzyme_mask;  // bit (1 << EnzymeType) for each enzyme used, see EnzymeMask
+    uint32_t max_miss_cleavage;
+    uint32_t append_decoy;
+    double min_mass;
+    double max_mass;
+    uint64_t min_length;  // residues, see Digester::min_length and max_length
+    uint64_t max_length;
+    uint64_t protein_num;
+    uint64_t peptide_num;
+
+    static constexpr const char* kMagic = "PPDTABLE";
+    static constexpr uint32_t kVersion = 2;  // 1 had no length limits
+};
+static_assert(sizeof(PeptTableHeader) == 72, "PeptTableHeader must be packed for the on-disk layout");
+
+// stream records into a table file, header is patched with the final count on Close()
+class PeptTableWriter {
+public:
+    PeptTableWriter(const char* filename, PeptTableHeader header)
+            : file_(filename, std::ios::binary | std::ios::trunc), header_(header) {
+        if (!file_) { throw std::runtime_error("Fail to create peptide table file."); }
+        std::memcpy(header_.magic, PeptTableHeader::kMagic, sizeof(header_.magic));
+        header_.version = PeptTableHeader::kVersion;
+        header_.peptide_num = 0;
+        file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    }
+
+    void Write(const PeptRecord& record) {
+        file_.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        ++header_.peptide_num;
+    }
+
+    uint64_t Close() {
+        file_.seekp(0);
+        file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+        file_.close();
+        if (!file_) { throw std::runtime_error("Fail to write peptide table file."); }
+        return header_.peptide_num;
+    }
+
+private:
+    std::ofstream file_;
+    PeptTableHeader header_;
+};
+
+// memory mapped, read-only view of a table file
+class PeptTable {
+public:
+    explicit PeptTable(const char* filename) : file_(filename) {
+        if (file_.size() < sizeof(PeptTableHeader)) {
+            throw std::runtime_error("Peptide table file is truncated.");
+        }
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, PeptTableHeader::kMagic, sizeof(header_.magic)) != 0
+                || header_.version != PeptTableHeader::kVersion) {
+            throw std::runtime_error("Not a peptide table file.");
+        }
+        if (file_.size() < sizeof(PeptTableHeader) + header_.peptide_num * sizeof(PeptRecord)) {
+            throw std::runtime_error("Peptide table file is truncated.");
+        }
+        records_ = reinterpret_cast<const PeptRecord*>(file_.data() + sizeof(PeptTableHeader));
+    }
+
+    const PeptTableHeader& header() const { return header_; }
+    size_t size() const { return static_cast<size_t>(header_.peptide_num); }
+    const PeptRecord& operator[](const size_t index) const { return records_[index]; }
+
+    const PeptRecord* begin() const { return records_; }
+    const PeptRecord* end() const { return records_ + size(); }
+
+    const PeptRecord* lower_bound(double lower_mass) const {
+        return std::lower_bound(begin(), end(), lower_mass,
+            [](const PeptRecord& record, double val) { return record.mass < val; });
+    }
+    const PeptRecord* upper_bound(double upper_mass) const {
+        return std::upper_bound(begin(), end(), upper_mass,
+            [](double val, const PeptRecord& record) { return val < record.mass; });
+    }
+
+private:
+    MappedFile file_;
+    PeptTableHeader header_;
+    const PeptRecord* records_ = nullptr;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "PPData.h"
+#include "Hash.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// peptides are equal when their sequences are, which are I/L-normalized already
+struct SequenceKey {
+    uint32_t Hash(const PPData::Peptide& peptide) const {
+        auto hash = HashSequence(peptide.sequence, peptide.sequence_length);
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+    bool Equal(const PPData::Peptide& one, const PPData::Peptide& another) const {
+        return one.sequence_length == another.sequence_length
+               && std::memcmp(one.sequence, another.sequence, one.sequence_length) == 0;
+    }
+};
+
+// open-addressing set of distinct peptides for the dedup of a build, Swiss-table style,
+// one control byte per slot holds 7 bits of the hash or marks the slot empty, and the 16
+// control bytes of a group are matched at once, slots hold the 32-bit id of a peptide and
+// its 32-bit hash, so sequences are only compared when both match and growing never reads
+// a sequence, peptides are stored by id in insertion order and the first of equal ones is
+// kept, as std::unordered_set::insert does, Key hashes and compares peptides
+template <typename Key = SequenceKey>
+class BasicPeptideSet {
+public:
+    using Peptide = PPData::Peptide;
+
+    explicit BasicPeptideSet(size_t expected_num = 0, const Key& key = Key()) : key_(key) { Reserve(expected_num); }
+
+    // room for num peptides without growing
+    void Reserve(size_t num) {
+        peptides_.reserve(num);
+        size_t group_num = 1;
+        while (group_num * kGroupSize * kMaxLoadNumerator / kMaxLoadDenominator < num) { group_num *= 2; }
+        if (group_num > group_mask_ + 1 || control_.empty()) { Rehash(group_num); }
+    }
+
+    // return false if an equal peptide is in the set already
+    bool Insert(const Peptide& peptide) { return Emplace(peptide, Hash(peptide)).second; }
+
+    // id of the peptide equal to peptide, and whether it was just added, hash is Hash(peptide)
+    std::pair<uint32_t, bool> Emplace(const Peptide& peptide, uint32_t hash) {
+        if ((peptides_.size() + 1) * kMaxLoadDenominator > slots_.size() * kMaxLoadNumerator) {
+            Rehash((group_mask_ + 1) * 2);
+        }
+        auto fingerprint = static_cast<int8_t>(hash & 0x7f);
+        auto group = (hash >> 7) & group_mask_;
+        for (size_t step = 1;; ++step) {
+            auto control = &control_[group * kGroupSize];
+            for (auto matches = Match(control, fingerprint); matches != 0; matches &= matches - 1) {
+                auto& slot = slots_[group * kGroupSize + LowestBit(matches)];
+                if (slot.hash == hash && key_.Equal(peptides_[slot.id], peptide)) { return std::make_pair(slot.id, false); }
+            }
+            auto empties = Match(control, kEmpty);
+            if (empties != 0) {
+                if (peptides_.size() >= UINT32_MAX) { throw std::runtime_error("Too many peptides for 32-bit ids."); }
+                auto index = group * kGroupSize + LowestBit(empties);
+                auto id = static_cast<uint32_t>(peptides_.size());
+                control_[index] = fingerprint;
+                slots_[index] = Slot{ id, hash };
+                peptides_.push_back(peptide);
+                return std::make_pair(id, true);
+            }
+            group = (group + step) & group_mask_;  // triangular probing visits every group
+        }
+    }
+
+    size_t size() const { return peptides_.size(); }
+    const Peptide& operator[](uint32_t id) const { return peptides_[id]; }
+    Peptide& operator[](uint32_t id) { return peptides_[id]; }  // replace by an equal peptide only
+    auto begin() const { return peptides_.cbegin(); }
+    auto end() const { return peptides_.cend(); }
+
+    size_t memory_bytes() const {
+        return control_.capacity() + slots_.capacity() * sizeof(Slot) + peptides_.capacity() * sizeof(Peptide);
+    }
+
+    // the peptides in insertion order, the set is left empty
+    std::vector<Peptide> Release() {
+        std::vector<Peptide> peptides;
+        peptides.swap(peptides_);
+        std::vector<int8_t>().swap(control_);
+        std::vector<Slot>().swap(slots_);
+        Rehash(1);
+        return peptides;
+    }
+
+    uint32_t Hash(const Peptide& peptide) const { return key_.Hash(peptide); }
+
+private:
+    enum : size_t { kGroupSize = 16, kMaxLoadNumerator = 7, kMaxLoadDenominator = 8 };
+    enum : int8_t { kEmpty = -128 };
+
+    struct Slot {
+        uint32_t id;
+        uint32_t hash;
+    };
+
+    const Key key_;
+    std::vector<int8_t> control_;
+    std::vector<Slot> slots_;
+    std::vector<Peptide> peptides_;
+    size_t group_mask_ = 0;
+
+    // bit i set where control[i] == value
+    static uint32_t Match(const int8_t* control, int8_t value) {
+#ifdef __SSE2__
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupSize; ++i) { mask |= static_cast<uint32_t>(control[i] == value) << i; }
+        return mask;
+#endif
+    }
+
+    static unsigned LowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+        unsigned bit = 0;
+        while (!(mask & 1u)) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    // ids keep their place, only slots move, by their cached hashes
+    void Rehash(size_t group_num) {
+        std::vector<int8_t> control(group_num * kGroupSize, kEmpty);
+        std::vector<Slot> slots(group_num * kGroupSize);
+        control.swap(control_);
+        slots.swap(slots_);
+        group_mask_ = group_num - 1;
+        for (size_t i = 0; i < control.size(); ++i) {
+            if (control[i] == kEmpty) { continue; }
+            auto group = (slots[i].hash >> 7) & group_mask_;
+            for (size_t step = 1;; ++step) {
+                auto empties = Match(&control_[group * kGroupSize], kEmpty);
+                if (empties != 0) {
+                    auto index = group * kGroupSize + LowestBit(empties);
+                    control_[index] = control[i];
+                    slots_[index] = slots[i];
+                    break;
+                }
+                group = (group + step) & group_mask_;
+            }
+        }
+    }
+};
+
+using PeptideSet = BasicPeptideSet<>;
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "PPData.h"
+#include "MassTable.h"
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// peptides matching a precursor under several charge states and isotope errors in one
+// query, the windows of every (charge, isotope) pair are merged where they overlap and
+// cut into ranges of the same set of matching windows, so that no peptide is returned
+// twice, the boundaries of all windows are searched for together
+class PrecursorQuery {
+public:
+    struct Range {
+        size_t first;
+        size_t last;
+        uint32_t windows;  // bit charge_index * isotope_num + isotope_index for every window matched
+        unsigned charge;   // charge and isotope error of the lowest window matched
+        int isotope;
+
+        size_t size() const { return last - first; }
+    };
+
+    // tolerance in Da, or in ppm of the neutral mass
+    PrecursorQuery(const std::vector<unsigned>& charges, const std::vector<int>& isotopes,
+                   double tolerance, bool ppm = false)
+            : charges_(charges), isotopes_(isotopes), tolerance_(tolerance), ppm_(ppm) {
+        if (charges_.empty() || isotopes_.empty() || charges_.size() * isotopes_.size() > 32) {
+            throw std::runtime_error("Precursor query needs 1 to 32 charge and isotope combinations.");
+        }
+    }
+
+    static double IsotopeSpacing() { return 1.0033548378; }  // 13C - 12C
+
+    size_t window_num() const { return charges_.size() * isotopes_.size(); }
+
+    // ranges by increasing index
+    void Query(const PPData& ppdata, double precursor_mz, std::vector<Range>& ranges) const {
+        ranges.clear();
+        if (ppdata.size() == 0) { return; }
+        std::array<Window, 32> windows;
+        size_t window_num = 0;
+        for (size_t c = 0; c < charges_.size(); ++c) {
+            auto mass = (precursor_mz - MassTable::Proton()) * charges_[c];
+            for (size_t i = 0; i < isotopes_.size(); ++i) {
+                auto center = mass - isotopes_[i] * IsotopeSpacing();
+                auto width = ppm_ ? center * tolerance_ * 1e-6 : tolerance_;
+                windows[window_num++] = Window{ center - width, center + width,
+                                                static_cast<uint32_t>(c * isotopes_.size() + i) };
+            }
+        }
+
+        // a window [min, max] is the lower bound of min up to the lower bound of just above max
+        std::array<Boundary, 64> boundaries;
+        size_t boundary_num = 0;
+        for (size_t w = 0; w < window_num; ++w) {
+            boundaries[boundary_num++] = Boundary{ windows[w].min_mass, windows[w].bit, true, 0 };
+            boundaries[boundary_num++] = Boundary{
+                std::nextafter(windows[w].max_mass, std::numeric_limits<double>::infinity()), windows[w].bit, false, 0 };
+        }
+        std::sort(boundaries.begin(), boundaries.begin() + boundary_num, [](const Boundary& one, const Boundary& another) {
+            return one.mass < another.mass || (one.mass == another.mass && !one.opening && another.opening);
+        });
+        Locate(ppdata, boundaries.data(), boundary_num);
+
+        // sweep, the windows open between two boundaries make the tag of the peptides there
+        uint32_t mask = 0;
+        size_t previous = 0;
+        for (size_t b = 0; b < boundary_num; ++b) {
+            auto& boundary = boundaries[b];
+            if (boundary.index > previous && mask != 0) { AddRange(previous, boundary.index, mask, ranges); }
+            previous = boundary.index;
+            if (boundary.opening) { mask |= 1u << boundary.bit; }
+            else { mask &= ~(1u << boundary.bit); }
+        }
+    }
+
+private:
+    struct Window {
+        double min_mass;
+        double max_mass;
+        uint32_t bit;
+    };
+    struct Boundary {
+        double mass;
+        uint32_t bit;
+        bool opening;
+        size_t index;
+    };
+
+    const std::vector<unsigned> charges_;
+    const std::vector<int> isotopes_;
+    const double tolerance_;
+    const bool ppm_;
+
+    void AddRange(size_t first, size_t last, uint32_t mask, std::vector<Range>& ranges) const {
+        if (!ranges.empty() && ranges.back().last == first && ranges.back().windows == mask) {
+            ranges.back().last = last;
+            return;
+        }
+        auto lowest = LowestBit(mask);
+        ranges.push_back(Range{ first, last, mask, charges_[lowest / isotopes_.size()],
+                                isotopes_[lowest % isotopes_.size()] });
+    }
+
+    static unsigned LowestBit(uint32_t mask) {
+        unsigned bit = 0;
+        while (!(mask & 1u)) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+    }
+
+    // lower bound of every boundary mass, one level of the binary searches for all of them
+    // before the next, the searches are branch-free and independent so that their cache
+    // misses overlap, masses are read by index, which also works for a mapped table,
+    // ppdata is not empty
+    static void Locate(const PPData& ppdata, Boundary* boundaries, size_t num) {
+        std::array<size_t, 64> bases;
+        std::fill(bases.begin(), bases.begin() + num, 0);
+        auto length = ppdata.size();
+        while (length > 1) {
+            auto half = length / 2;
+            for (size_t i = 0; i < num; ++i) {
+                bases[i] += ppdata.mass(bases[i] + half) < boundaries[i].mass ? half : 0;
+            }
+            length -= half;
+        }
+        for (size_t i = 0; i < num; ++i) {
+            boundaries[i].index = bases[i] + (ppdata.mass(bases[i]) < boundaries[i].mass ? 1 : 0);
+        }
+    }
+};
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "PPData.h"
+#include "BuildRecorder.h"
+#include "Digester.h"
 #include <fstream>
+#include <cstdint>
 #include <vector>
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -10,32 +14,37 @@ class ProtData {
 public:
     using Protein = PPData::Protein;
 
-    ProtData(const char* filename, bool append_decoy) 
-            : database_name_(filename), append_decoy_(append_decoy) {
-        ReadTargetData(filename);  // read refined fasta into target_data_
-        BuildTargetProteins();  // build target proteins into proteins_
+    // with normalize, I is converted to L in the sequences as they are compacted, so that
+    // peptides can point into them, see OriginalResidue
+    ProtData(const char* filename, bool append_decoy, BuildRecorder* recorder = nullptr, bool normalize = false)
+            : database_name_(filename), append_decoy_(append_decoy), normalized_(normalize) {
+        ReadTargetData(filename, recorder);  // read refined fasta into target_data_
+        BuildTargetProteins(recorder);  // build target proteins into proteins_
         if (append_decoy) {  // build decoy_data_ and append decoys into proteins_
-            BuildDecoy();
+            BuildDecoy(recorder);
         }
     }
 
     size_t size() const { return proteins_.size(); }
+    const Protein& operator[](const size_t index) const { return proteins_[index]; }
     auto begin() const { return proteins_.cbegin(); }
     auto end() const { return proteins_.cend(); }
 
-private:
-    const char* const database_name_;
-    const bool append_decoy_;
-
-    std::vector<char> target_data_;
-    std::vector<char> decoy_data_;
-    std::vector<Protein> proteins_;
-
-    enum class ParseState { Start, Name, Sequence };  // reuse twice
+    bool append_decoy() const { return append_decoy_; }
+    bool normalized() const { return normalized_; }
+
+    // residue offset of protein as read from the fasta, for the residues flanking a peptide,
+    // a normalized build keeps the original I only next to residues Digester::CleavesAfter,
+    // elsewhere the I converted to L stays L
+    char OriginalResidue(const Protein& protein, size_t offset) const {
+        auto residue = protein.sequence[offset];
+        if (residue != 'L' || isoleucines_.empty()) { return residue; }
+        auto key = IsoleucineKey(static_cast<size_t>(&protein - proteins_.data()), offset);
+        return std::binary_search(isoleucines_.begin(), isoleucines_.end(), key) ? 'I' : residue;
+    }
 
-    // builders used in ctor
-    void ReadTargetData(const char* filename) {
-        // read data into memory
+    // build stages, each usable on its own so that benchmarks can time them separately
+    static std::vector<char> ReadFile(const char* filename) {
         std::basic_ifstream<char> file(filename, std::ios::binary);
         if (!file) { throw std::runtime_error("Fail to open fasta database file."); }
         file.unsetf(std::ios::skipws);
@@ -45,11 +54,21 @@ private:
         std::vector<char> raw_data(size + 1);  // one more character for '\0'
         file.read(&raw_data.front(), static_cast<std::streamsize>(size));
         raw_data[size] = 0;
+        return raw_data;
+    }
 
-        // concatenate sequence in memory, by copying the data to a new place
-        target_data_.resize(raw_data.size());
+    // concatenate sequence in memory, by copying the data to a new place, if isoleucines is
+    // given, I is converted to L on the way and the I next to a residue Digester::CleavesAfter
+    // are recorded into it, sorted, by IsoleucineKey
+    static void CompactFasta(const std::vector<char>& raw_data, std::vector<char>& target_data,
+                             std::vector<uint64_t>* isoleucines = nullptr) {
+        target_data.resize(raw_data.size());
         auto state = ParseState::Name;
         auto index = 0;
+        size_t protein = 0;
+        size_t offset = 0;  // in the sequence of protein
+        auto previous = '\0';  // residue, normalized
+        auto pending = false;  // the previous residue is an unrecorded I
         for (auto& c : raw_data) {
             switch (state) {
             case ParseState::Start:
@@ -57,93 +76,169 @@ private:
                 break;
             case ParseState::Name:
                 if (c == '\n') {
-                    target_data_[index++] = '\0';
+                    target_data[index++] = '\0';
                     state = ParseState::Sequence;
+                    offset = 0;
+                    previous = '\0';
+                    pending = false;
                 }
                 else {
-                    target_data_[index++] = c;
+                    target_data[index++] = c;
                 }
                 break;
             case ParseState::Sequence:
                 if (c == '>') {
-                    target_data_[index++] = '\0';
-                    target_data_[index++] = '>';
+                    target_data[index++] = '\0';
+                    target_data[index++] = '>';
                     state = ParseState::Name;
+                    ++protein;
                 }
                 else if (c != ' ' && c != '\r' && c != '\n' && c != '\t') {
-                    target_data_[index++] = c;
+                    if (!isoleucines) {
+                        target_data[index++] = c;
+                        break;
+                    }
+                    if (pending && Digester::CleavesAfter(c)) { isoleucines->push_back(IsoleucineKey(protein, offset - 1)); }
+                    pending = c == 'I' && !Digester::CleavesAfter(previous);
+                    if (c == 'I' && !pending) { isoleucines->push_back(IsoleucineKey(protein, offset)); }
+                    previous = Digester::Normalize(c);
+                    target_data[index++] = previous;
+                    ++offset;
                 }
                 break;
             }
         }
-        target_data_.resize(index);
+        target_data.resize(index);
     }
 
-    void BuildTargetProteins() {
+    static void ParseProteins(const std::vector<char>& target_data, std::vector<Protein>& proteins) {
+        // every protein but the first starts with '>', reserve for them at once
+        proteins.reserve(proteins.size() + 1 + std::count(target_data.begin(), target_data.end(), '>'));
+
         // parse fasta
         auto state = ParseState::Start;  // reuse the same state
         const char* temp_name = nullptr;
-        for (unsigned i = 0; i < target_data_.size(); ++i) {
+        for (unsigned i = 0; i < target_data.size(); ++i) {
             switch (state) {
             case ParseState::Start:
-                if (target_data_[i] == '>') { state = ParseState::Name; }
+                if (target_data[i] == '>') { state = ParseState::Name; }
                 break;
             case ParseState::Name:
-                temp_name = &target_data_[i];
-                while (target_data_[i] != '\0') { ++i; }
+                temp_name = &target_data[i];
+                while (target_data[i] != '\0') { ++i; }
                 state = ParseState::Sequence;
                 break;
             case ParseState::Sequence:
-                const char* temp_sequence = &target_data_[i];
-                while (target_data_[i] != '\0') { ++i; }
-                size_t temp_length = &target_data_[i] - temp_sequence;
+                const char* temp_sequence = &target_data[i];
+                while (target_data[i] != '\0') { ++i; }
+                size_t temp_length = &target_data[i] - temp_sequence;
                 // build protein
-                proteins_.push_back(Protein(temp_name, temp_sequence, temp_length));
+                proteins.push_back(Protein(temp_name, temp_sequence, temp_length));
                 state = ParseState::Start;
                 break;
             }
         }
     }
 
-    void BuildDecoy() {
-        auto target_protein_num = proteins_.size();
-        auto decoy_datamap_size = target_data_.size() + target_protein_num * 6;  // add DECOY_ prefix before protein name
-        decoy_data_.resize(decoy_datamap_size);
-
-        auto decoy_index = 0;
+    // append reversed decoys of the target proteins, target_data_size is the size of
+    // the data holding the targets, which bounds the decoy data, isoleucines (if given)
+    // holds those recorded by CompactFasta and gets the mirrored ones of the decoys, as
+    // both neighbours of a residue are checked, they are the ones a decoy needs
+    static void BuildDecoys(std::vector<Protein>& proteins, size_t target_data_size, std::vector<char>& decoy_data,
+                            std::vector<uint64_t>* isoleucines = nullptr) {
+        auto target_protein_num = proteins.size();
+        auto decoy_datamap_size = target_data_size + target_protein_num * 6;  // add DECOY_ prefix before protein name
+        decoy_data.resize(decoy_datamap_size);
+        proteins.reserve(2 * target_protein_num);
+
+        size_t decoy_index = 0;
         for (unsigned i = 0; i < target_protein_num; ++i) {
             const char* decoy_name;
             const char* decoy_sequence;
             size_t decoy_sequence_length;
 
             // build each decoy protein
-            decoy_data_[decoy_index++] = '>';
-            decoy_name = &decoy_data_[decoy_index];
-            FillDecoyPrefix(decoy_index);
+            decoy_data[decoy_index++] = '>';
+            decoy_name = &decoy_data[decoy_index];
+            FillDecoyPrefix(decoy_data, decoy_index);
 
-            auto& target_protein = proteins_[i];
+            auto& target_protein = proteins[i];
             for (unsigned j = 0; target_protein.name[j] != '\0'; ++j) {
-                decoy_data_[decoy_index++] = target_protein.name[j];
+                decoy_data[decoy_index++] = target_protein.name[j];
             }
-            decoy_data_[decoy_index++] = '\0';
+            decoy_data[decoy_index++] = '\0';
 
-            decoy_sequence = &decoy_data_[decoy_index];
+            decoy_sequence = &decoy_data[decoy_index];
             for (int j = target_protein.sequence_length - 1; target_protein.sequence[j] != '\0'; --j) {
-                decoy_data_[decoy_index++] = target_protein.sequence[j];
+                decoy_data[decoy_index++] = target_protein.sequence[j];
             }
-            decoy_sequence_length = &decoy_data_[decoy_index] - decoy_sequence;
-            decoy_data_[decoy_index++] = '\0';
+            decoy_sequence_length = &decoy_data[decoy_index] - decoy_sequence;
+            decoy_data[decoy_index++] = '\0';
 
             // build decoy protein
-            proteins_.push_back(Protein(decoy_name, decoy_sequence, decoy_sequence_length));
+            proteins.push_back(Protein(decoy_name, decoy_sequence, decoy_sequence_length));
         }
-        assert(decoy_data_.size() == decoy_index);
+        assert(decoy_data.size() == decoy_index);
+
+        if (isoleucines) {
+            auto target_end = isoleucines->size();
+            for (size_t i = 0, first = 0; i < target_protein_num; ++i) {
+                auto last = first;
+                while (last < target_end && ((*isoleucines)[last] >> 32) == i) { ++last; }
+                for (auto j = last; j-- > first;) {
+                    auto offset = static_cast<size_t>((*isoleucines)[j] & UINT32_MAX);
+                    isoleucines->push_back(IsoleucineKey(target_protein_num + i, proteins[i].sequence_length - 1 - offset));
+                }
+                first = last;
+            }
+        }
+    }
+
+private:
+    const char* const database_name_;
+    const bool append_decoy_;
+    const bool normalized_;
+
+    std::vector<char> target_data_;
+    std::vector<char> decoy_data_;
+    std::vector<Protein> proteins_;
+    std::vector<uint64_t> isoleucines_;  // sorted, of a normalized build, see OriginalResidue
+
+    enum class ParseState { Start, Name, Sequence };  // reuse twice
+
+    // protein index in the high half, offset in its sequence in the low half
+    static uint64_t IsoleucineKey(size_t protein, size_t offset) { return (uint64_t(protein) << 32) | offset; }
+
+    // builders used in ctor
+    void ReadTargetData(const char* filename, BuildRecorder* recorder) {
+        BuildStageTimer read_timer(recorder, "ReadFile");
+        auto raw_data = ReadFile(filename);  // read data into memory
+        read_timer.Stop(0, raw_data.size(), raw_data.capacity());
+
+        BuildStageTimer compact_timer(recorder, "CompactFasta");
+        CompactFasta(raw_data, target_data_, normalized_ ? &isoleucines_ : nullptr);
+        compact_timer.Stop(raw_data.size(), target_data_.size(), raw_data.capacity() + target_data_.capacity()
+                           + isoleucines_.capacity() * sizeof(uint64_t));
+    }
+
+    void BuildTargetProteins(BuildRecorder* recorder) {
+        BuildStageTimer timer(recorder, "ParseProteins");
+        ParseProteins(target_data_, proteins_);
+        timer.Stop(target_data_.size(), proteins_.size(), proteins_.capacity() * sizeof(Protein));
+    }
+
+    void BuildDecoy(BuildRecorder* recorder) {
+        BuildStageTimer timer(recorder, "BuildDecoys");
+        auto target_num = proteins_.size();
+        BuildDecoys(proteins_, target_data_.size(), decoy_data_, normalized_ ? &isoleucines_ : nullptr);
+        timer.Stop(target_num, proteins_.size() - target_num,
+                   decoy_data_.capacity() + proteins_.capacity() * sizeof(Protein));
     }
 
-    void FillDecoyPrefix(int& index) {
+    static void FillDecoyPrefix(std::vector<char>& decoy_data, size_t& index) {
         const char* const prefix = "DECOY_";
         for (auto i = 0; i < 6; ++i) {
-            decoy_data_[index++] = prefix[i];
+            decoy_data[index++] = prefix[i];
         }
     }
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+// histogram of all candidate scores of one spectrum, the tail of its survival function is
+// fitted with a line in log10 space (as X!Tandem does for hyperscores), which estimates
+// how many random candidates reach a given score, i.e. the E-value,
+// scores are counted in fixed width bins, those beyond the last bin go into it
+class ScoreHistogram {
+public:
+    explicit ScoreHistogram(double bin_width = 1.0, size_t bin_num = 1024)
+            : inverse_width_(1.0 / bin_width), counts_(std::max<size_t>(bin_num, 1), 0) {}
+
+    void Clear() {
+        std::fill(counts_.begin(), counts_.begin() + used_, 0);
+        total_ = 0;
+        used_ = 0;
+        fitted_ = false;
+    }
+
+    void Add(double score) {
+        auto value = std::max(score * inverse_width_, 0.0);
+        auto bin = static_cast<size_t>(std::min(value, static_cast<double>(counts_.size() - 1)));
+        ++counts_[bin];
+        ++total_;
+        used_ = std::max(used_, bin + 1);
+        fitted_ = false;
+    }
+
+    size_t total() const { return total_; }
+
+    double EValue(double score) {
+        if (!fitted_) { Fit(); }
+        if (slope_ >= 0) {  // too few scores for a fit, fall back to the empirical count
+            auto bin = static_cast<size_t>(std::max(score * inverse_width_, 0.0));
+            size_t count = 0;
+            for (auto i = std::min(bin, used_); i < used_; ++i) { count += counts_[i]; }
+            return static_cast<double>(std::max<size_t>(count, 1));
+        }
+        return std::pow(10.0, intercept_ + slope_ * score);
+    }
+
+private:
+    const double inverse_width_;
+    std::vector<uint32_t> counts_;
+    size_t total_ = 0;
+    size_t used_ = 0;  // bins beyond are 0
+    bool fitted_ = false;
+    double slope_ = 0;
+    double intercept_ = 0;
+    std::vector<double> survival_;  // scratch of Fit()
+
+    // least squares on log10 of the survival function, from the mode up to the last
+    // bin still surviving twice, so that the best match itself does not bend the line
+    void Fit() {
+        fitted_ = true;
+        slope_ = 0;
+        intercept_ = 0;
+        if (used_ == 0) { return; }
+        auto mode = static_cast<size_t>(std::max_element(counts_.begin(), counts_.begin() + used_) - counts_.begin());
+        auto& survival = survival_;
+        survival.assign(used_ + 1, 0);
+        for (auto i = used_; i-- > 0;) { survival[i] = survival[i + 1] + counts_[i]; }
+
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (auto i = mode + 1; i < used_ && survival[i] >= 2; ++i) {
+            auto x = i / inverse_width_;  // survival[i] counts scores >= x
+            auto y = std::log10(survival[i]);
+            n += 1;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        if (n < 3) { return; }
+        auto denominator = n * sxx - sx * sx;
+        if (denominator <= 0) { return; }
+        slope_ = (n * sxy - sx * sy) / denominator;
+        intercept_ = (sy - slope_ * sx) / n;
+        if (slope_ >= 0) { slope_ = 0; }
+    }
+};
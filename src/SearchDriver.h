@@ -0,0 +1,187 @@
+#pragma once
+
+#include "PPData.h"
+#include "Spectrum.h"
+#include "TopN.h"
+#include "ScoreHistogram.h"
+#include "MassCursor.h"
+#include "MassShiftHistogram.h"
+#include <memory>
+#include <utility>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+struct SearchReport {
+    size_t spectrum_num = 0;
+    size_t candidate_num = 0;
+    size_t steal_num = 0;
+    size_t cursor_restart_num = 0;  // candidate windows found by binary search, see MassCursor
+    double seconds = 0;
+
+    double spectra_per_second() const { return seconds > 0 ? spectrum_num / seconds : 0; }
+};
+
+// parallel candidate enumeration and scoring, spectra are sorted by precursor mass, cut into
+// small tasks, each worker gets a contiguous block of them on its deque, pops its own tasks
+// from the front so its precursor masses only increase and, once out of work, steals from the
+// back of the others, which balances the skewed cost of wide precursor windows while stolen
+// tasks are the only ones moving a cursor backwards, the scorer is any class providing
+//     typename Scorer::Context                      per-thread scratch, default constructible
+//     void Prepare(const Spectrum&, Context&) const  once per spectrum
+//     double Score(const PPData::Peptide&, Context&) const  once per candidate
+// every score goes into a per-worker histogram, from which the E-values of the kept
+// matches are estimated, score_bin_width should suit the range of the scorer,
+// candidates are the peptides within tolerance of the precursor mass, or for an open
+// search those whose mass shift (precursor - peptide mass) is within shift_window,
+// found by a MassCursor per worker since the spectra of a task come by increasing mass
+template <typename Scorer>
+class SearchDriver {
+public:
+    SearchDriver(const PPData& ppdata, const Scorer& scorer, double tolerance, size_t top_n,
+                 unsigned thread_num = std::thread::hardware_concurrency(), double score_bin_width = 0.1)
+            : SearchDriver(ppdata, scorer, std::make_pair(-tolerance, tolerance), top_n, thread_num, score_bin_width) {}
+    SearchDriver(const PPData& ppdata, const Scorer& scorer, std::pair<double, double> shift_window, size_t top_n,
+                 unsigned thread_num = std::thread::hardware_concurrency(), double score_bin_width = 0.1)
+            : ppdata_(ppdata), scorer_(scorer), min_shift_(shift_window.first), max_shift_(shift_window.second),
+              top_n_(top_n), thread_num_(std::max(1u, thread_num)), score_bin_width_(score_bin_width) {}
+
+    // results[i] gets the best top_n matches of batch[i] by decreasing score, with E-values,
+    // the mass shifts of the best matches are added to shifts if given
+    SearchReport Search(const SpectrumBatch& batch, std::vector<std::vector<PSM>>& results,
+                        MassShiftHistogram* shifts = nullptr) const {
+        auto start = std::chrono::steady_clock::now();
+        results.assign(batch.size(), std::vector<PSM>());
+        std::vector<size_t> order(batch.size());
+        for (size_t i = 0; i < order.size(); ++i) { order[i] = i; }
+        std::stable_sort(order.begin(), order.end(), [&](size_t one, size_t another) {
+            return batch[one].precursor_mass < batch[another].precursor_mass;
+        });
+
+        std::vector<Worker> workers(thread_num_);
+        if (shifts != nullptr) {
+            for (auto& worker : workers) {
+                worker.shifts.reset(new MassShiftHistogram(*shifts));
+                worker.shifts->Clear();
+            }
+        }
+        auto task_num = (batch.size() + kTaskSize - 1) / kTaskSize;
+        for (size_t task_id = 0; task_id < task_num; ++task_id) {
+            auto first = task_id * kTaskSize;
+            workers[task_id * thread_num_ / task_num].tasks.push_back(
+                Task{ first, std::min(first + kTaskSize, batch.size()) });
+        }
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < thread_num_; ++i) {
+            threads.emplace_back([&, i]() { Run(i, workers, batch, order, results); });
+        }
+        Run(0, workers, batch, order, results);
+        for (auto& thread : threads) { thread.join(); }
+
+        SearchReport report;
+        report.spectrum_num = batch.size();
+        for (auto& worker : workers) {
+            report.candidate_num += worker.candidate_num;
+            report.steal_num += worker.steal_num;
+            report.cursor_restart_num += worker.cursor_restart_num;
+            if (shifts != nullptr) { shifts->Merge(*worker.shifts); }
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+private:
+    enum : size_t { kTaskSize = 4 };  // spectra per task
+
+    struct Task {
+        size_t first;
+        size_t last;
+    };
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        size_t candidate_num = 0;
+        size_t steal_num = 0;
+        size_t cursor_restart_num = 0;
+        std::unique_ptr<MassShiftHistogram> shifts;
+    };
+
+    const PPData& ppdata_;
+    const Scorer& scorer_;
+    const double min_shift_;
+    const double max_shift_;
+    const size_t top_n_;
+    const unsigned thread_num_;
+    const double score_bin_width_;
+
+    bool PopOwn(Worker& worker, Task& task) const {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) { return false; }
+        task = worker.tasks.front();
+        worker.tasks.pop_front();
+        return true;
+    }
+
+    bool Steal(unsigned thief, std::vector<Worker>& workers, Task& task) const {
+        for (unsigned i = 1; i < workers.size(); ++i) {
+            auto& victim = workers[(thief + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Run(unsigned id, std::vector<Worker>& workers, const SpectrumBatch& batch,
+             const std::vector<size_t>& order, std::vector<std::vector<PSM>>& results) const {
+        auto& worker = workers[id];
+        typename Scorer::Context context;
+        TopN top(top_n_);
+        ScoreHistogram histogram(score_bin_width_);
+        MassCursor cursor(ppdata_);
+        Task task;
+        while (true) {
+            if (!PopOwn(worker, task)) {
+                if (!Steal(id, workers, task)) {  // tasks are never added, so all work is taken
+                    worker.cursor_restart_num = cursor.restart_num();
+                    return;
+                }
+                ++worker.steal_num;
+            }
+            for (auto i = task.first; i < task.last; ++i) {
+                auto& spectrum = batch[order[i]];
+                auto& result = results[order[i]];
+                worker.candidate_num += SearchSpectrum(spectrum, context, top, histogram, cursor, result);
+                if (worker.shifts && !result.empty()) {
+                    worker.shifts->Add(spectrum.precursor_mass - ppdata_.mass(result.front().peptide));
+                }
+            }
+        }
+    }
+
+    size_t SearchSpectrum(const Spectrum& spectrum, typename Scorer::Context& context, TopN& top,
+                          ScoreHistogram& histogram, MassCursor& cursor, std::vector<PSM>& result) const {
+        auto span = cursor.Advance(spectrum.precursor_mass - max_shift_, spectrum.precursor_mass - min_shift_);
+        if (span.empty() || top_n_ == 0) { return 0; }
+
+        scorer_.Prepare(spectrum, context);
+        top.Reset(top_n_);
+        histogram.Clear();
+        for (auto i = span.first; i < span.last; ++i) {
+            auto score = scorer_.Score(ppdata_.peptide(i), context);
+            top.Push(i, score);
+            histogram.Add(score);
+        }
+        top.Extract(result);
+        for (auto& psm : result) { psm.e_value = histogram.EValue(psm.score); }
+        return span.size();
+    }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "PPData.h"
+#include "ProtData.h"
+#include "Digester.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+// cut the peptide mass space into ranges holding about the same number of peptides,
+// using a mass histogram collected by a digestion pass that keeps no peptides, peptides
+// for which filter (if given) is false are not counted
+class ShardPlanner {
+public:
+    using Shard = PPData::Shard;
+    using Filter = std::function<bool(const char* sequence, size_t length, double mass)>;
+
+    ShardPlanner(const ProtData& proteins, const Digester& digester, const Filter& filter = nullptr)
+            : min_mass_(digester.min_mass()), max_mass_(digester.max_mass()),
+              bin_width_((digester.max_mass() - digester.min_mass()) / kBinNum),
+              histogram_(kBinNum, 0) {
+        std::vector<char> compact_sequence;  // reused scratch for the I/L conversion
+        for (auto& protein : proteins) {
+            auto sequence = protein.sequence;
+            if (!proteins.normalized()) {
+                compact_sequence.resize(protein.sequence_length);
+                for (unsigned i = 0; i < protein.sequence_length; ++i) {
+                    compact_sequence[i] = Digester::Normalize(protein.sequence[i]);
+                }
+                sequence = compact_sequence.data();
+            }
+            // duplicates are counted as well, which only slightly skews the balance
+            digester.Digest(sequence, protein.sequence_length,
+                [&](size_t start, size_t end, double mass) {
+                    if (!filter || filter(sequence + start, end - start, mass)) { ++histogram_[Bin(mass)]; }
+                }
+            );
+        }
+    }
+
+    std::vector<Shard> Plan(unsigned shard_num, double margin) const {
+        if (shard_num == 0) { throw std::runtime_error("Shard number should be positive."); }
+        unsigned long long total = 0;
+        for (auto count : histogram_) { total += count; }
+
+        // shard i ends at the first bin edge where the cumulative count reaches (i + 1) / N of total
+        std::vector<double> edges(1, min_mass_);
+        unsigned long long cumulative = 0;
+        size_t bin = 0;
+        for (unsigned i = 1; i < shard_num; ++i) {
+            if (total == 0) {  // nothing to balance, split evenly
+                edges.push_back(min_mass_ + (max_mass_ - min_mass_) * i / shard_num);
+                continue;
+            }
+            auto target = total * i / shard_num;
+            while (bin < histogram_.size() && cumulative < target) { cumulative += histogram_[bin++]; }
+            edges.push_back(min_mass_ + bin * bin_width_);
+        }
+        edges.push_back(max_mass_);
+
+        std::vector<Shard> shards;
+        for (unsigned i = 0; i < shard_num; ++i) {
+            Shard shard;
+            shard.core_min_mass = edges[i];
+            shard.core_max_mass = edges[i + 1];
+            shard.min_mass = std::max(min_mass_, edges[i] - margin);
+            shard.max_mass = std::min(max_mass_, edges[i + 1] + margin);
+            shards.push_back(shard);
+        }
+        return shards;
+    }
+
+private:
+    enum : size_t { kBinNum = 1 << 16 };
+
+    const double min_mass_;
+    const double max_mass_;
+    const double bin_width_;
+    std::vector<unsigned long long> histogram_;
+
+    size_t Bin(double mass) const {
+        if (!(bin_width_ > 0)) { return 0; }
+        auto bin = static_cast<size_t>((mass - min_mass_) / bin_width_);
+        return bin < kBinNum ? bin : kBinNum - 1;  // max_mass itself falls into the last bin
+    }
+};
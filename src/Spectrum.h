@@ -0,0 +1,88 @@
+#pragma once
+
+#include "PPData.h"
+#include "MassTable.h"
+#include <vector>
+#include <utility>
+
+// MS2 spectrum as produced by the spectrum readers, peaks and text point into the
+// batch (or the mapped file) they were read with, and are valid until the next batch
+struct Spectrum {
+    const char* title;
+    size_t title_length;
+    double precursor_mz;
+    unsigned charge;
+    double precursor_mass;  // neutral mass, comparable to PPData::Peptide::mass
+    const double* mz;
+    const double* intensity;
+    size_t peak_num;
+};
+
+// storage for a batch of spectra, reused from batch to batch
+class SpectrumBatch {
+public:
+    size_t size() const { return spectra_.size(); }
+    bool empty() const { return spectra_.empty(); }
+    const Spectrum& operator[](const size_t index) const { return spectra_[index]; }
+    auto begin() const { return spectra_.cbegin(); }
+    auto end() const { return spectra_.cend(); }
+
+    // builders used by the readers, peaks are added to the last spectrum,
+    // pointers are resolved in Finish() since the buffers may still grow
+    void Clear() {
+        spectra_.clear();
+        peak_starts_.clear();
+        text_starts_.clear();
+        mz_.clear();
+        intensity_.clear();
+        text_.clear();
+    }
+    void AddSpectrum(const char* title, size_t title_length, double precursor_mz, unsigned charge) {
+        spectra_.push_back(Spectrum{ title, title_length, precursor_mz, charge,
+                                     NeutralMass(precursor_mz, charge), nullptr, nullptr, 0 });
+        peak_starts_.push_back(mz_.size());
+        text_starts_.push_back(static_cast<size_t>(-1));
+    }
+    // title copied into the batch, for readers that do not keep their input around
+    void AddSpectrumCopy(const char* title, size_t title_length, double precursor_mz, unsigned charge) {
+        AddSpectrum(nullptr, title_length, precursor_mz, charge);
+        text_starts_.back() = text_.size();
+        text_.insert(text_.end(), title, title + title_length);
+    }
+    void AddPeak(double mz, double intensity) {
+        mz_.push_back(mz);
+        intensity_.push_back(intensity);
+    }
+    void Finish() {
+        for (size_t i = 0; i < spectra_.size(); ++i) {
+            auto end = i + 1 < spectra_.size() ? peak_starts_[i + 1] : mz_.size();
+            spectra_[i].mz = mz_.data() + peak_starts_[i];
+            spectra_[i].intensity = intensity_.data() + peak_starts_[i];
+            spectra_[i].peak_num = end - peak_starts_[i];
+            if (text_starts_[i] != static_cast<size_t>(-1)) { spectra_[i].title = text_.data() + text_starts_[i]; }
+        }
+    }
+
+    static double NeutralMass(double precursor_mz, unsigned charge) {
+        return (precursor_mz - MassTable::Proton()) * charge;
+    }
+
+private:
+    std::vector<Spectrum> spectra_;
+    std::vector<size_t> peak_starts_;
+    std::vector<size_t> text_starts_;
+    std::vector<double> mz_;
+    std::vector<double> intensity_;
+    std::vector<char> text_;
+};
+
+// peptide index range [first, last) of every spectrum whose mass is within
+// tolerance (in Da) of its precursor mass
+inline void PrecursorRanges(const PPData& ppdata, const SpectrumBatch& batch, double tolerance,
+                            std::vector<std::pair<size_t, size_t>>& ranges) {
+    ranges.clear();
+    for (auto& spectrum : batch) {
+        ranges.push_back(std::make_pair(ppdata.lower_bound(spectrum.precursor_mass - tolerance),
+                                        ppdata.upper_bound(spectrum.precursor_mass + tolerance)));
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+
+// deterministic synthetic proteome for tests and benchmarks, residues follow the UniProtKB
+// amino acid composition and lengths a log-normal distribution around the median length
+// of UniProtKB/Swiss-Prot, a fraction of the proteins are isoforms of earlier ones (a few
+// point mutations), so that peptides are shared between proteins as in real databases,
+// only std::mt19937 is used from <random>, whose output is fixed by the standard, and
+// uniform values are made from its bits with exact arithmetic, but the log-normal lengths
+// go through std::log, std::cos and std::exp, whose last bits may differ between math
+// libraries, so the same parameters give the same file with the same toolchain only
+class SyntheticProteome {
+public:
+    struct Options {
+        size_t protein_num = 20000;
+        unsigned seed = 1;
+        double median_length = 300;
+        double length_sigma = 0.65;  // of log(length)
+        size_t min_length = 30;
+        size_t max_length = 5000;
+        double isoform_fraction = 0.1;
+        unsigned isoform_mutations = 3;
+    };
+
+    explicit SyntheticProteome(const Options& options) : options_(options), engine_(options.seed) {
+        if (options_.min_length == 0 || options_.min_length > options_.max_length) {
+            throw std::runtime_error("Invalid synthetic protein length range.");
+        }
+        Generate();
+    }
+    explicit SyntheticProteome(size_t protein_num, unsigned seed = 1)
+            : SyntheticProteome(MakeOptions(protein_num, seed)) {}
+
+    size_t size() const { return sequences_.size(); }
+    const std::string& name(size_t index) const { return names_[index]; }
+    const std::string& sequence(size_t index) const { return sequences_[index]; }
+
+    size_t residue_num() const {
+        size_t num = 0;
+        for (auto& sequence : sequences_) { num += sequence.size(); }
+        return num;
+    }
+
+    // fasta with 60 residues per line
+    void Write(std::ostream& out) const {
+        for (size_t i = 0; i < size(); ++i) { WriteEntry(out, names_[i], sequences_[i]); }
+    }
+    void Write(const char* filename) const {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) { throw std::runtime_error("Fail to create synthetic fasta file."); }
+        Write(file);
+    }
+
+    // one fasta entry in the same format, for databases edited from a generated one
+    static void WriteEntry(std::ostream& out, const std::string& name, const std::string& sequence) {
+        out << '>' << name << '\n';
+        for (size_t j = 0; j < sequence.size(); j += 60) {
+            out.write(sequence.data() + j, static_cast<std::streamsize>(std::min<size_t>(60, sequence.size() - j)));
+            out << '\n';
+        }
+    }
+
+private:
+    const Options options_;
+    std::mt19937 engine_;
+    std::vector<std::string> names_;
+    std::vector<std::string> sequences_;
+
+    static Options MakeOptions(size_t protein_num, unsigned seed) {
+        Options options;
+        options.protein_num = protein_num;
+        options.seed = seed;
+        return options;
+    }
+
+    // uniform in [0, 1)
+    double Uniform() {
+        uint64_t high = engine_() >> 5;  // 27 bits
+        uint64_t low = engine_() >> 6;   // 26 bits
+        return static_cast<double>(high << 26 | low) / 9007199254740992.0;  // 2^53
+    }
+
+    // Box-Muller, one value per call
+    double Normal() {
+        double u;
+        do { u = Uniform(); } while (u == 0);
+        return std::sqrt(-2 * std::log(u)) * std::cos(6.283185307179586 * Uniform());
+    }
+
+    char Residue() {
+        // UniProtKB composition in 1/10000, sums to 10000
+        static const char residues[] = "ARNDCQEGHILKMFPSTWYV";
+        static const unsigned cumulative[] = {
+             825, 1378, 1784, 2329, 2466, 2859, 3534, 4241, 4468, 5064,
+            6030, 6614, 6856, 7242, 7712, 8368, 8902, 9010, 9302, 10000
+        };
+        auto value = static_cast<unsigned>(Uniform() * 10000);
+        unsigned i = 0;
+        while (cumulative[i] <= value) { ++i; }
+        return residues[i];
+    }
+
+    size_t Length() {
+        auto length = options_.median_length * std::exp(options_.length_sigma * Normal());
+        auto rounded = static_cast<size_t>(std::max(length, 0.0) + 0.5);
+        return std::min(std::max(rounded, options_.min_length), options_.max_length);
+    }
+
+    void Generate() {
+        names_.reserve(options_.protein_num);
+        sequences_.reserve(options_.protein_num);
+        for (size_t i = 0; i < options_.protein_num; ++i) {
+            auto id = std::to_string(i + 1);
+            std::string sequence;
+            if (i > 0 && Uniform() < options_.isoform_fraction && sequences_[i - 1].size() > 1) {
+                sequence = sequences_[static_cast<size_t>(Uniform() * i)];
+                if (sequence.size() < 2) { sequence = sequences_[i - 1]; }
+                for (unsigned m = 0; m < options_.isoform_mutations; ++m) {
+                    sequence[1 + static_cast<size_t>(Uniform() * (sequence.size() - 1))] = Residue();
+                }
+                names_.push_back("sp|SYN" + id + "|SYN" + id + "_SYNTH Synthetic isoform " + id + " OS=Synthetic");
+            }
+            else {
+                sequence.resize(Length());
+                sequence[0] = 'M';
+                for (size_t j = 1; j < sequence.size(); ++j) { sequence[j] = Residue(); }
+                names_.push_back("sp|SYN" + id + "|SYN" + id + "_SYNTH Synthetic protein " + id + " OS=Synthetic");
+            }
+            sequences_.push_back(std::move(sequence));
+        }
+    }
+};
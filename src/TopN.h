@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+// peptide-spectrum match
+struct PSM {
+    size_t peptide;  // index in PPData
+    double score;
+    double e_value;  // expected number of random candidates scoring at least as high
+};
+
+// best N matches of one spectrum, a min-heap on score over storage that is reused from
+// spectrum to spectrum, so that once the capacity was reached nothing is allocated,
+// meant to be owned by a single thread, next to the scorer context
+class TopN {
+public:
+    explicit TopN(size_t capacity = 0) { Reset(capacity); }
+
+    void Reset(size_t capacity) {
+        capacity_ = capacity;
+        heap_.clear();
+        heap_.reserve(capacity);
+    }
+
+    size_t size() const { return heap_.size(); }
+    size_t capacity() const { return capacity_; }
+    bool full() const { return heap_.size() == capacity_; }
+
+    // lowest score that still gets in, once full
+    double threshold() const {
+        return full() && capacity_ > 0 ? heap_.front().score : -std::numeric_limits<double>::infinity();
+    }
+
+    // return whether the match was kept
+    bool Push(size_t peptide, double score) {
+        if (!full()) {
+            heap_.push_back(PSM{ peptide, score, 0 });
+            std::push_heap(heap_.begin(), heap_.end(), Greater);
+            return true;
+        }
+        if (capacity_ == 0 || !(score > heap_.front().score)) { return false; }
+        std::pop_heap(heap_.begin(), heap_.end(), Greater);
+        heap_.back() = PSM{ peptide, score, 0 };
+        std::push_heap(heap_.begin(), heap_.end(), Greater);
+        return true;
+    }
+
+    // copy the matches out by decreasing score and empty the heap
+    void Extract(std::vector<PSM>& out) {
+        std::sort_heap(heap_.begin(), heap_.end(), Greater);
+        out.assign(heap_.begin(), heap_.end());
+        heap_.clear();
+    }
+
+private:
+    size_t capacity_ = 0;
+    std::vector<PSM> heap_;
+
+    static bool Greater(const PSM& one, const PSM& another) { return one.score > another.score; }
+};
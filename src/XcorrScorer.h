@@ -0,0 +1,97 @@
+#pragma once
+
+#include "PPData.h"
+#include "Spectrum.h"
+#include "FragGen.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+// Comet style fast XCorr, a scorer for SearchDriver, the spectrum is binned (unit bins,
+// square root intensities), normalized to 50 in each of 10 windows, and the mean over
+// +-75 neighbouring bins is subtracted, all once per spectrum, so that the cross correlation
+// of a candidate reduces to the sum of the preprocessed bins of its b/y ions
+class XcorrScorer {
+public:
+    struct Context {
+        std::vector<float> raw;
+        std::vector<float> bins;  // preprocessed, the last bin stays 0 for ions out of range
+        std::vector<double> ions;
+        std::vector<double> prefix;
+        bool fragment_charge_2 = false;
+    };
+
+    XcorrScorer(double bin_width = 1.0005079, double bin_offset = 0.4, double max_fragment_mz = 5000.0)
+            : inverse_width_(1.0 / bin_width), shift_(1.0 - bin_offset),
+              bin_num_(static_cast<size_t>(max_fragment_mz / bin_width + 1.0 - bin_offset) + 2),
+              charge_1_(FragmentGenerator::kB | FragmentGenerator::kY, 1),
+              charge_2_(FragmentGenerator::kB | FragmentGenerator::kY, 2) {}
+
+    size_t Bin(double mz) const {
+        return std::min(static_cast<size_t>(mz * inverse_width_ + shift_), bin_num_ - 1);
+    }
+
+    void Prepare(const Spectrum& spectrum, Context& context) const {
+        auto& raw = context.raw;
+        auto& bins = context.bins;
+        raw.assign(bin_num_, 0);
+        bins.assign(bin_num_, 0);
+        context.fragment_charge_2 = spectrum.charge >= 3;
+
+        float max_intensity = 0;
+        size_t max_bin = 0;
+        for (size_t i = 0; i < spectrum.peak_num; ++i) {
+            auto bin = Bin(spectrum.mz[i]);
+            if (bin == bin_num_ - 1 || !(spectrum.intensity[i] > 0)) { continue; }
+            auto intensity = static_cast<float>(std::sqrt(spectrum.intensity[i]));
+            raw[bin] = std::max(raw[bin], intensity);
+            max_intensity = std::max(max_intensity, intensity);
+            max_bin = std::max(max_bin, bin);
+        }
+        if (max_intensity == 0) { return; }
+
+        // windowed normalization, peaks under 5% of the base peak are dropped
+        auto window_size = max_bin / kWindowNum + 1;
+        for (size_t start = 0; start <= max_bin; start += window_size) {
+            auto end = std::min(start + window_size, max_bin + 1);
+            float window_max = 0;
+            for (auto i = start; i < end; ++i) {
+                if (raw[i] < 0.05f * max_intensity) { raw[i] = 0; }
+                window_max = std::max(window_max, raw[i]);
+            }
+            if (window_max == 0) { continue; }
+            for (auto i = start; i < end; ++i) { raw[i] *= 50 / window_max; }
+        }
+
+        // subtract the mean of the +-75 neighbours with a sliding window sum,
+        // and fold in the final 0.005 scale of Comet
+        const auto last = static_cast<long>(bin_num_) - 1;
+        double sum = 0;
+        for (long i = 0; i <= std::min<long>(kOffset, last - 1); ++i) { sum += raw[i]; }
+        for (long i = 0; i < last; ++i) {
+            bins[i] = static_cast<float>(0.005 * (raw[i] - (sum - raw[i]) / (2 * kOffset)));
+            if (i + kOffset + 1 < last) { sum += raw[i + kOffset + 1]; }
+            if (i - kOffset >= 0) { sum -= raw[i - kOffset]; }
+        }
+    }
+
+    double Score(const PPData::Peptide& peptide, Context& context) const {
+        auto& generator = context.fragment_charge_2 ? charge_2_ : charge_1_;
+        auto ion_num = generator.Generate(peptide, context.ions, context.prefix);
+        auto bins = context.bins.data();
+        auto ions = context.ions.data();
+        float sum = 0;
+        for (size_t i = 0; i < ion_num; ++i) { sum += bins[Bin(ions[i])]; }
+        return sum;
+    }
+
+private:
+    enum : long { kWindowNum = 10, kOffset = 75 };
+
+    const double inverse_width_;
+    const double shift_;
+    const size_t bin_num_;
+    const FragmentGenerator charge_1_;
+    const FragmentGenerator charge_2_;
+};
@@ -1,34 +1,1440 @@
+#define PPDATA_COUNT_ALLOCATIONS  // the build report counts the allocations of this program
+#include <AllocationCounter.h>
 #include <PPData.h>
 #include <ProtData.h>
 #include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <random>
+#include <fstream>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <PeptData.h>
+#include <BuildState.h>
+#include <PPDataHolder.h>
+#include <FragIndex.h>
+#include <MassTable.h>
+#include <FragGen.h>
+#include <FragCache.h>
+#include <MgfReader.h>
+#include <MzmlReader.h>
+#include <Base64.h>
+#include <SearchDriver.h>
+#include <TopN.h>
+#include <ScoreHistogram.h>
+#include <MassCursor.h>
+#include <MassShiftHistogram.h>
+#include <PrecursorQuery.h>
+#include <HyperScorer.h>
+#include <XcorrScorer.h>
+#include <SyntheticProteome.h>
+#include <PeptideSet.h>
+#include <ConcurrentPeptideSet.h>
+#include <PackedSequences.h>
+#include <unordered_set>
+#include <Digester.h>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+// a file in the temporary directory, removed when the test is done with it
+class TempFile {
+public:
+    explicit TempFile(const std::string& name) : path_(Directory() + "/ppdata_test_" + name) {}
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+    ~TempFile() { std::remove(path_.c_str()); }
+
+    operator const char*() const { return path_.c_str(); }
+
+private:
+    const std::string path_;
+
+    static std::string Directory() {
+        for (auto variable : { "TMPDIR", "TMP", "TEMP" }) {
+            auto directory = std::getenv(variable);
+            if (directory && *directory) { return directory; }
+        }
+#ifdef _WIN32
+        return ".";
+#else
+        return "/tmp";
+#endif
+    }
+};
+
+using PeptideKey = std::tuple<std::string, double, std::string, size_t>;
+
+static std::multiset<PeptideKey> PeptideKeys(const PPData& ppdata) {
+    std::multiset<PeptideKey> keys;
+    for (size_t i = 0; i < ppdata.size(); ++i) {
+        auto peptide = ppdata.peptide(i);
+        keys.insert(PeptideKey(std::string(peptide.sequence, peptide.sequence_length), peptide.mass,
+                               std::string(peptide.protein->name), peptide.offset));
+    }
+    return keys;
+}
 
 TEST(Unittest_PPData, PPData_API) {
     PPData ppdata("uniprot-all.fasta", false, PPData::EnzymeType::Trypsin, 0, 700, 5000);
-    EXPECT_EQ(554376, ppdata.size());
+    EXPECT_EQ(554376u, ppdata.size());
 //    auto range = ppdata.LoopWithin(700, 5000);
 //    EXPECT_EQ(554376, std::distance(range.begin(), range.end()));
 
     PPData ppdata2("uniprot-all.fasta", false, PPData::EnzymeType::Trypsin, 1, 700, 5000);
-    EXPECT_EQ(1465360, ppdata2.size());
+    EXPECT_EQ(1465360u, ppdata2.size());
 //    iters = peptset2.RetrieveMassRange(700, 5000);
 //    EXPECT_EQ(1465360, std::distance(iters.first, iters.second));
 
     PPData ppdata3("uniprot-all.fasta", false, PPData::EnzymeType::Trypsin, 2, 700, 5000);
-    EXPECT_EQ(2404590, ppdata3.size());
+    EXPECT_EQ(2404590u, ppdata3.size());
 //    iters = peptset3.RetrieveMassRange(700, 5000);
 //    EXPECT_EQ(2404590, std::distance(iters.first, iters.second));
 }
 
 TEST(Unittest_PPData, ProtData_API) {
     auto fasta = ProtData("uniprot-all.fasta", false);
-    EXPECT_EQ(20198, fasta.size());
+    EXPECT_EQ(20198u, fasta.size());
 
     auto decoy = ProtData("uniprot-all.fasta", true);
-    EXPECT_EQ(20198 * 2, decoy.size());
+    EXPECT_EQ(20198u * 2, decoy.size());
 }
 
 TEST(Unittest_PPData, PeptNum) {
     PPData ppdata("random20000.fasta", true,
                   PPData::EnzymeType::Trypsin, 2, 1000, 5000);
-    EXPECT_EQ(0, ppdata.size());
-}
\ No newline at end of file
+    EXPECT_EQ(0u, ppdata.size());
+}
+TEST(Unittest_PPData, BuildTable) {
+    TempFile table_fasta("table.fasta");
+    TempFile table_ppdt("table.ppdt");
+    SyntheticProteome(800, 7).Write(table_fasta);
+    PPData ppdata(table_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+
+    // a tiny budget forces many spilled runs and a multi-pass merge
+    auto count = PPData::BuildTable(table_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000,
+                                    table_ppdt, 4096);
+    EXPECT_EQ(ppdata.size(), count);
+    PPData loaded(table_fasta, true, table_ppdt);
+    ASSERT_EQ(ppdata.size(), loaded.size());
+
+    // the same peptide at every index, built from the mapped records
+    EXPECT_THROW(static_cast<void>(loaded[0]), std::logic_error);
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        auto& expected = ppdata[i];
+        auto peptide = loaded.peptide(i);
+        ASSERT_EQ(std::string(expected.sequence, expected.sequence_length),
+                  std::string(peptide.sequence, peptide.sequence_length));
+        ASSERT_EQ(expected.mass, peptide.mass);
+        ASSERT_EQ(expected.mass, loaded.mass(i));
+        ASSERT_STREQ(expected.protein->name, peptide.protein->name);
+        ASSERT_EQ(expected.offset, peptide.offset);
+        ASSERT_EQ(expected.n_term, peptide.n_term);
+        ASSERT_EQ(expected.c_term, peptide.c_term);
+    }
+    for (double mass : { 0.0, 600.0, 1000.0, 1234.5, 3000.0, 5000.0, 6000.0 }) {
+        EXPECT_EQ(ppdata.lower_bound(mass), loaded.lower_bound(mass));
+        EXPECT_EQ(ppdata.upper_bound(mass), loaded.upper_bound(mass));
+    }
+
+    EXPECT_THROW(PPData(table_fasta, false, table_ppdt), std::runtime_error);
+    EXPECT_FALSE(std::ifstream(std::string(table_ppdt) + ".run0").good());
+
+    // a table whose decoy setting differs from the requested one is rejected
+    {
+        std::fstream file(table_ppdt, std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t append_decoy = 0;
+        file.seekp(offsetof(PeptTableHeader, append_decoy));
+        file.write(reinterpret_cast<const char*>(&append_decoy), sizeof(append_decoy));
+    }
+    EXPECT_THROW(PPData(table_fasta, true, table_ppdt), std::runtime_error);
+
+    // options the positional arguments do not reach, the digestion options go into the header
+    PPData::Options options;
+    options.append_decoy = true;
+    options.additional_enzymes = { PPData::EnzymeType::GluC };
+    options.max_miss_cleavage = 1;
+    options.min_length = 7;
+    options.max_length = 25;
+    options.filter = [](const char* sequence, size_t length, double) {
+        return std::memchr(sequence, 'W', length) == nullptr;
+    };
+    options.normalize_in_place = true;
+    PPData filtered(table_fasta, options);
+    EXPECT_EQ(filtered.size(), PPData::BuildTable(table_fasta, options, table_ppdt, 4096));
+    EXPECT_EQ(PeptideKeys(filtered), PeptideKeys(PPData(table_fasta, true, table_ppdt)));
+    PeptTable table(table_ppdt);
+    EXPECT_EQ(EnzymeMask(options), table.header().enzyme_mask);
+    EXPECT_EQ(7u, table.header().min_length);
+    EXPECT_EQ(25u, table.header().max_length);
+}
+
+TEST(Unittest_PPData, PlanShards) {
+    TempFile shard_fasta("shard.fasta");
+    SyntheticProteome(300, 11).Write(shard_fasta);
+    PPData ppdata(shard_fasta, true, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    auto shards = PPData::PlanShards(shard_fasta, true, PPData::EnzymeType::Trypsin, 1, 600, 5000, 4, 1.0);
+    ASSERT_EQ(4u, shards.size());
+    EXPECT_EQ(600, shards.front().core_min_mass);
+    EXPECT_EQ(5000, shards.back().core_max_mass);
+
+    std::multiset<PeptideKey> core_keys;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        auto& shard = shards[i];
+        PPData shard_data(shard_fasta, true, PPData::EnzymeType::Trypsin, 1, shard.min_mass, shard.max_mass);
+        size_t core_num = 0;
+        for (size_t j = 0; j < shard_data.size(); ++j) {
+            auto& peptide = shard_data[j];
+            EXPECT_GE(peptide.mass, shard.min_mass);
+            EXPECT_LE(peptide.mass, shard.max_mass);
+            bool last = i + 1 == shards.size();
+            if (shard.core_min_mass <= peptide.mass
+                    && (peptide.mass < shard.core_max_mass || (last && peptide.mass <= shard.core_max_mass))) {
+                core_keys.insert(PeptideKey(std::string(peptide.sequence, peptide.sequence_length), peptide.mass,
+                                            std::string(peptide.protein->name), peptide.offset));
+                ++core_num;
+            }
+        }
+        // balanced within a few percent
+        EXPECT_NEAR(ppdata.size() / 4.0, core_num, ppdata.size() * 0.05);
+    }
+    EXPECT_EQ(PeptideKeys(ppdata), core_keys);
+
+    // peptides the filter drops are not counted
+    PPData::Options options;
+    options.append_decoy = true;
+    options.max_miss_cleavage = 1;
+    options.filter = [](const char*, size_t, double mass) { return mass >= 2000; };
+    PPData filtered(shard_fasta, options);
+    shards = PPData::PlanShards(shard_fasta, options, 4, 1.0);
+    ASSERT_EQ(4u, shards.size());
+    EXPECT_GE(shards[1].core_min_mass, 2000);
+    for (auto& shard : shards) {
+        auto core_num = filtered.lower_bound(shard.core_max_mass) - filtered.lower_bound(shard.core_min_mass);
+        EXPECT_NEAR(filtered.size() / 4.0, core_num, filtered.size() * 0.05);
+    }
+}
+
+TEST(Unittest_PPData, IncrementalBuild) {
+    TempFile release1_fasta("release1.fasta");
+    TempFile release_state("release.state");
+    TempFile release2_fasta("release2.fasta");
+    SyntheticProteome proteome(300, 13);
+    proteome.Write(release1_fasta);
+    std::remove(release_state);
+    PPData release1(release1_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000, release_state);
+
+    // next release: 5 changed, 3 deleted, 4 added proteins
+    {
+        SyntheticProteome added(4, 17);
+        std::ofstream release2(release2_fasta);
+        for (size_t i = 0; i < proteome.size(); ++i) {
+            if (i >= 100 && i < 103) { continue; }
+            if (i == 150) {
+                for (size_t j = 0; j < added.size(); ++j) {
+                    SyntheticProteome::WriteEntry(release2, "sp|NEW" + std::to_string(j), added.sequence(j));
+                }
+            }
+            auto sequence = proteome.sequence(i);
+            if (i % 50 == 7 && i < 250) { sequence[20] = sequence[20] == 'W' ? 'C' : 'W'; }
+            SyntheticProteome::WriteEntry(release2, proteome.name(i), sequence);
+        }
+    }
+
+    ProtData prot_data(release2_fasta, true);
+    auto state = BuildState::Load(release_state);
+    PeptData incremental(prot_data, PPData::EnzymeType::Trypsin, 2, 600, 5000, state);
+    EXPECT_EQ(2u * (5 + 4), state.digested_protein_num());  // targets and their decoys
+    EXPECT_EQ(prot_data.size() - 2 * (5 + 4), state.reused_protein_num());
+
+    PeptData full(prot_data, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    ASSERT_EQ(full.size(), incremental.size());
+    for (size_t i = 0; i < full.size(); ++i) {
+        ASSERT_EQ(std::string(full[i].sequence, full[i].sequence_length),
+                  std::string(incremental[i].sequence, incremental[i].sequence_length));
+        ASSERT_EQ(full[i].mass, incremental[i].mass);
+        ASSERT_EQ(full[i].protein, incremental[i].protein);
+        ASSERT_EQ(full[i].offset, incremental[i].offset);
+    }
+
+    PPData release2(release2_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000, release_state);
+    EXPECT_EQ(full.size(), release2.size());
+
+    // digests kept under other length limits are not reused
+    state = BuildState::Load(release_state);
+    PeptData limited(prot_data, PPData::EnzymeType::Trypsin, 2, 600, 5000, state, nullptr, 7, 30);
+    EXPECT_EQ(0u, state.reused_protein_num());
+    PPData::Options options;
+    options.max_miss_cleavage = 2;
+    options.min_mass = 600;
+    options.max_mass = 5000;
+    options.min_length = 7;
+    options.max_length = 30;
+    PeptData limited_full(prot_data, options);
+    EXPECT_EQ(limited_full.size(), limited.size());
+    EXPECT_LT(limited.size(), full.size());
+
+    // options the positional arguments do not reach, the state is reused across filters
+    options.append_decoy = true;
+    options.additional_enzymes = { PPData::EnzymeType::GluC };
+    options.filter = [](const char* sequence, size_t length, double) {
+        return std::memchr(sequence, 'W', length) == nullptr;
+    };
+    options.normalize_in_place = true;
+    std::remove(release_state);
+    EXPECT_EQ(PeptideKeys(PPData(release1_fasta, options)), PeptideKeys(PPData(release1_fasta, options, release_state)));
+    options.filter = [](const char*, size_t, double mass) { return mass < 3000; };
+    ProtData normalized(release2_fasta, true, nullptr, true);
+    state = BuildState::Load(release_state);
+    PeptData reused(normalized, options, state);
+    EXPECT_EQ(normalized.size() - 2 * (5 + 4), state.reused_protein_num());
+    PeptData reused_full(normalized, options);
+    ASSERT_EQ(reused_full.size(), reused.size());
+    for (size_t i = 0; i < reused_full.size(); ++i) {
+        ASSERT_EQ(std::string(reused_full[i].sequence, reused_full[i].sequence_length),
+                  std::string(reused[i].sequence, reused[i].sequence_length));
+        ASSERT_EQ(reused_full[i].protein, reused[i].protein);
+        ASSERT_EQ(reused_full[i].offset, reused[i].offset);
+        ASSERT_EQ(reused_full[i].n_term, reused[i].n_term);
+    }
+    EXPECT_EQ(PeptideKeys(PPData(release2_fasta, options)), PeptideKeys(PPData(release2_fasta, options, release_state)));
+}
+
+TEST(Unittest_PPData, HolderHotSwap) {
+    TempFile holder1_fasta("holder1.fasta");
+    TempFile holder2_fasta("holder2.fasta");
+    SyntheticProteome(100, 19).Write(holder1_fasta);
+    SyntheticProteome(200, 23).Write(holder2_fasta);
+    PPData release1(holder1_fasta, false, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    PPData release2(holder2_fasta, false, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    ASSERT_NE(release1.size(), release2.size());
+
+    PPDataHolder holder(std::unique_ptr<const PPData>(
+        new PPData(holder1_fasta, false, PPData::EnzymeType::Trypsin, 1, 600, 5000)));
+    {
+        auto old_snapshot = holder.Acquire();
+        holder.Reload(std::string(holder2_fasta), false, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+        holder.Wait();
+        EXPECT_EQ(1u, holder.version());
+        EXPECT_EQ(release1.size(), old_snapshot->size());  // in-flight reader keeps the old database
+        EXPECT_EQ(release2.size(), holder.Acquire()->size());
+        EXPECT_EQ(1u, holder.Reclaim());
+    }
+    EXPECT_EQ(0u, holder.Reclaim());
+
+    // readers keep querying while the database is swapped several times
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> bad(0);
+    std::vector<std::thread> readers;
+    for (unsigned i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            while (!stop.load()) {
+                auto snapshot = holder.Acquire();
+                auto size = snapshot->size();
+                if (size != release1.size() && size != release2.size()) { ++bad; }
+                if (size > 0 && (*snapshot)[size - 1].mass > 5000) { ++bad; }
+            }
+        });
+    }
+    for (unsigned i = 0; i < 4; ++i) {
+        holder.Reload(std::string(i % 2 == 0 ? holder1_fasta : holder2_fasta),
+                      false, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+        holder.Wait();
+    }
+    stop.store(true);
+    for (auto& reader : readers) { reader.join(); }
+    EXPECT_EQ(0u, bad.load());
+    EXPECT_EQ(5u, holder.version());
+    EXPECT_EQ(0u, holder.Reclaim());
+}
+
+TEST(Unittest_PPData, FragIndex) {
+    TempFile fragment_fasta("fragment.fasta");
+    SyntheticProteome(200, 29).Write(fragment_fasta);
+    PPData ppdata(fragment_fasta, true, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    FragIndex index(ppdata);
+    EXPECT_GT(index.posting_num(), ppdata.size());
+
+    FragIndex::Workspace workspace;
+    std::vector<FragIndex::Candidate> candidates;
+    FragmentGenerator generator;
+    std::vector<double> peaks;
+    std::vector<double> prefix;
+    for (size_t target = 0; target < ppdata.size(); target += ppdata.size() / 20) {
+        auto& peptide = ppdata[target];
+        generator.Generate(peptide, peaks, prefix);
+        index.Query(peaks.data(), peaks.size(), peptide.mass - 100, peptide.mass + 100, 1, workspace, candidates);
+        ASSERT_FALSE(candidates.empty());
+
+        // the peptide itself shares all of its fragment bins, and nobody shares more
+        auto found = std::find_if(candidates.begin(), candidates.end(),
+                                  [&](const FragIndex::Candidate& c) { return c.index == target; });
+        ASSERT_NE(candidates.end(), found);
+        EXPECT_EQ(candidates.front().shared, found->shared);
+        for (auto& candidate : candidates) {
+            EXPECT_GE(ppdata[candidate.index].mass, peptide.mass - 100);
+            EXPECT_LE(ppdata[candidate.index].mass, peptide.mass + 100);
+        }
+    }
+}
+
+TEST(Unittest_PPData, FragmentGenerator) {
+    TempFile fragment_fasta("fragment.fasta");
+    SyntheticProteome(200, 29).Write(fragment_fasta);
+    PPData ppdata(fragment_fasta, false, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    FragmentGenerator generator(FragmentGenerator::kB | FragmentGenerator::kY | FragmentGenerator::kWaterLoss, 2);
+    EXPECT_EQ(4u, generator.series_num());
+
+    std::vector<double> ions;
+    std::vector<double> prefix;
+    for (size_t i = 0; i < ppdata.size(); ++i) {
+        auto& peptide = ppdata[i];
+        auto num = generator.Generate(peptide, ions, prefix);
+        auto n = peptide.sequence_length - 1;
+        ASSERT_EQ(4 * 2 * n, num);
+
+        // singly charged b and y from running sums of residue masses
+        auto b = MassTable::Proton();
+        auto y = MassTable::Water() + MassTable::Proton();
+        for (size_t k = 0; k < n; ++k) {
+            b += MassTable::Default()[peptide.sequence[k]];
+            y += MassTable::Default()[peptide.sequence[n - k]];
+            EXPECT_NEAR(b, ions[k], 1e-9);  // b, z = 1
+            EXPECT_NEAR((b + MassTable::Proton()) / 2, ions[n + k], 1e-9);  // b, z = 2
+            EXPECT_NEAR(y, ions[2 * n + k], 1e-9);  // y, z = 1
+            EXPECT_NEAR(b - MassTable::Water(), ions[4 * n + k], 1e-9);  // b-H2O, z = 1
+            EXPECT_NEAR(y - MassTable::Water(), ions[6 * n + k], 1e-9);  // y-H2O, z = 1
+        }
+    }
+}
+
+TEST(Unittest_PPData, FragmentCache) {
+    TempFile fragment_fasta("fragment.fasta");
+    SyntheticProteome(200, 29).Write(fragment_fasta);
+    PPData ppdata(fragment_fasta, false, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    FragmentGenerator generator(FragmentGenerator::kB | FragmentGenerator::kY, 2);
+    FragmentCache cache(ppdata, generator, 16 * 64 * 1024, 4);  // four slabs per shard
+
+    std::vector<double> expected;
+    std::vector<double> prefix;
+    std::vector<double> ions;
+    for (unsigned round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < ppdata.size(); ++i) {
+            generator.Generate(ppdata[i], expected, prefix);
+            cache.Get(i, ions);
+            ASSERT_EQ(expected, ions);
+        }
+    }
+    auto stats = cache.stats();
+    EXPECT_EQ(3 * ppdata.size(), stats.hits + stats.misses);
+    EXPECT_LE(stats.bytes, 16u * 64 * 1024);
+    EXPECT_GT(stats.evictions, 0u);  // the whole ladder set does not fit
+
+    // a small hot set stays cached
+    for (unsigned round = 0; round < 10; ++round) {
+        for (size_t i = 0; i < 20; ++i) { cache.Get(i, ions); }
+    }
+    auto hot = cache.stats();
+    EXPECT_GE(hot.hits - stats.hits, 9u * 20);
+}
+
+TEST(Unittest_PPData, MgfReader) {
+    TempFile spectra_mgf("spectra.mgf");
+    {
+        std::ofstream file(spectra_mgf, std::ios::binary);
+        file << "# comment line\r\n"
+             << "BEGIN IONS\r\nTITLE=first spectrum\r\nPEPMASS=500.25 1234.5\r\nCHARGE=2+\r\n"
+             << "100.5 10\r\n200.25\t2.5e3\r\n300 1E-2\r\nEND IONS\r\n"
+             << "BEGIN IONS\nTITLE=no precursor\n150 1\nEND IONS\n"
+             << "BEGIN IONS\nPEPMASS=1000.5\nTITLE=second\n  400.125 5  \nEND IONS\n"
+             << "BEGIN IONS\nTITLE=third\nCHARGE=3+ and 4+\nPEPMASS=700.0\nEND IONS\n";
+    }
+    MgfReader reader(spectra_mgf);
+    SpectrumBatch batch;
+    ASSERT_EQ(2u, reader.NextBatch(batch, 2));
+    EXPECT_EQ("first spectrum", std::string(batch[0].title, batch[0].title_length));
+    EXPECT_DOUBLE_EQ(500.25, batch[0].precursor_mz);
+    EXPECT_EQ(2u, batch[0].charge);
+    EXPECT_DOUBLE_EQ((500.25 - MassTable::Proton()) * 2, batch[0].precursor_mass);
+    ASSERT_EQ(3u, batch[0].peak_num);
+    EXPECT_DOUBLE_EQ(200.25, batch[0].mz[1]);
+    EXPECT_DOUBLE_EQ(2500, batch[0].intensity[1]);
+    EXPECT_DOUBLE_EQ(0.01, batch[0].intensity[2]);
+    EXPECT_EQ("second", std::string(batch[1].title, batch[1].title_length));
+    EXPECT_EQ(2u, batch[1].charge);  // default charge
+    ASSERT_EQ(1u, batch[1].peak_num);
+    EXPECT_DOUBLE_EQ(400.125, batch[1].mz[0]);
+
+    ASSERT_EQ(1u, reader.NextBatch(batch, 2));
+    EXPECT_EQ(3u, batch[0].charge);
+    EXPECT_EQ(0u, batch[0].peak_num);
+    EXPECT_EQ(0u, reader.NextBatch(batch, 2));
+
+    double value;
+    std::string number = "-12345.678901234567e-3";
+    ParseDouble(number.data(), number.data() + number.size(), value);
+    EXPECT_DOUBLE_EQ(-12.345678901234567, value);
+}
+
+static std::string EncodeBase64(const std::vector<uint8_t>& bytes) {
+    const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string text;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t block = bytes[i] << 16 | (i + 1 < bytes.size() ? bytes[i + 1] << 8 : 0)
+                         | (i + 2 < bytes.size() ? bytes[i + 2] : 0);
+        text += alphabet[block >> 18 & 63];
+        text += alphabet[block >> 12 & 63];
+        text += i + 1 < bytes.size() ? alphabet[block >> 6 & 63] : '=';
+        text += i + 2 < bytes.size() ? alphabet[block & 63] : '=';
+    }
+    return text;
+}
+
+template <typename T>
+static std::vector<uint8_t> ToBytes(const std::vector<T>& values) {
+    std::vector<uint8_t> bytes(values.size() * sizeof(T));
+    std::memcpy(bytes.data(), values.data(), bytes.size());
+    return bytes;
+}
+
+TEST(Unittest_PPData, Base64) {
+    std::vector<uint8_t> bytes(1000);
+    for (size_t i = 0; i < bytes.size(); ++i) { bytes[i] = static_cast<uint8_t>(i * 7 + i / 3); }
+    for (size_t length : { 0, 1, 2, 3, 11, 12, 13, 100, 1000 }) {
+        std::vector<uint8_t> input(bytes.begin(), bytes.begin() + length);
+        auto text = EncodeBase64(input);
+        std::vector<uint8_t> output(3 * text.size() / 4 + 16);
+        output.resize(Base64::Decode(text.data(), text.size(), output.data()));
+        EXPECT_EQ(input, output);
+    }
+    std::string wrapped = "QUJD\nREVG\r\nR0g=";  // whitespace inside the text
+    std::vector<uint8_t> output(32);
+    output.resize(Base64::Decode(wrapped.data(), wrapped.size(), output.data()));
+    EXPECT_EQ("ABCDEFGH", std::string(output.begin(), output.end()));
+}
+
+static std::string MzmlArray(const char* kind, const char* precision, const std::string& binary, bool compressed) {
+    return std::string("<binaryDataArray encodedLength=\"") + std::to_string(binary.size()) + "\">\n"
+           + "<cvParam cvRef=\"MS\" accession=\"" + precision + "\" name=\"float\" value=\"\"/>\n"
+           + (compressed ? "<cvParam cvRef=\"MS\" accession=\"MS:1000574\" name=\"zlib compression\" value=\"\"/>\n"
+                         : "<cvParam cvRef=\"MS\" accession=\"MS:1000576\" name=\"no compression\" value=\"\"/>\n")
+           + "<cvParam cvRef=\"MS\" accession=\"" + kind + "\" name=\"array\" value=\"\"/>\n"
+           + "<binary>" + binary + "</binary>\n</binaryDataArray>\n";
+}
+
+static std::string MzmlSpectrum(const char* id, unsigned ms_level, double mz, unsigned charge,
+                                const std::string& arrays) {
+    std::string text = std::string("<spectrum index=\"0\" id=\"") + id + "\" defaultArrayLength=\"3\">\n"
+                       + "<cvParam cvRef=\"MS\" accession=\"MS:1000511\" name=\"ms level\" value=\""
+                       + std::to_string(ms_level) + "\"/>\n";
+    if (ms_level == 2) {
+        text += "<precursorList count=\"1\"><precursor><selectedIonList count=\"1\"><selectedIon>\n"
+                "<cvParam cvRef=\"MS\" accession=\"MS:1000744\" name=\"selected ion m/z\" value=\""
+                + std::to_string(mz) + "\" unitAccession=\"MS:1000040\"/>\n";
+        if (charge != 0) {
+            text += "<cvParam cvRef=\"MS\" accession=\"MS:1000041\" name=\"charge state\" value=\""
+                    + std::to_string(charge) + "\"/>\n";
+        }
+        text += "</selectedIon></selectedIonList></precursor></precursorList>\n";
+    }
+    return text + "<binaryDataArrayList count=\"2\">\n" + arrays + "</binaryDataArrayList>\n</spectrum>\n";
+}
+
+TEST(Unittest_PPData, MzmlReader) {
+    TempFile spectra_mzml("spectra.mzML");
+    std::vector<double> mz = { 100.5, 200.25, 300.125 };
+    std::vector<float> intensity = { 10, 20.5f, 30 };
+    auto plain = MzmlArray("MS:1000514", "MS:1000523", EncodeBase64(ToBytes(mz)), false)
+                 + MzmlArray("MS:1000515", "MS:1000521", EncodeBase64(ToBytes(intensity)), false);
+    {
+        std::ofstream file(spectra_mzml, std::ios::binary);
+        file << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<mzML><run><spectrumList count=\"4\">\n";
+        file << MzmlSpectrum("scan=1", 1, 0, 0, plain);
+        for (unsigned i = 0; i < 50; ++i) {  // enough spectra to span several chunks
+            file << MzmlSpectrum(("scan=" + std::to_string(i + 2)).c_str(), 2, 500.25 + i, i % 2 == 0 ? 3 : 0, plain);
+        }
+#ifdef PPDATA_WITH_ZLIB
+        auto bytes = ToBytes(mz);
+        std::vector<uint8_t> compressed(compressBound(bytes.size()));
+        uLongf compressed_size = compressed.size();
+        compress(compressed.data(), &compressed_size, bytes.data(), bytes.size());
+        compressed.resize(compressed_size);
+        file << MzmlSpectrum("scan=zlib", 2, 800.5, 2,
+                             MzmlArray("MS:1000514", "MS:1000523", EncodeBase64(compressed), true)
+                             + MzmlArray("MS:1000515", "MS:1000521", EncodeBase64(ToBytes(intensity)), false));
+#endif
+        file << "</spectrumList></run></mzML>\n";
+    }
+
+    MzmlReader reader(spectra_mzml, 4096);
+    SpectrumBatch batch;
+    size_t total = 0;
+    ASSERT_EQ(8u, reader.NextBatch(batch, 8));
+    EXPECT_EQ("scan=2", std::string(batch[0].title, batch[0].title_length));  // MS1 skipped
+    EXPECT_DOUBLE_EQ(500.25, batch[0].precursor_mz);
+    EXPECT_EQ(3u, batch[0].charge);
+    EXPECT_EQ(2u, batch[1].charge);  // default charge
+    ASSERT_EQ(3u, batch[0].peak_num);
+    EXPECT_EQ(mz[2], batch[0].mz[2]);
+    EXPECT_EQ(20.5, batch[0].intensity[1]);
+    total += batch.size();
+    while (reader.NextBatch(batch, 8) > 0) {
+        total += batch.size();
+        for (auto& spectrum : batch) {
+            ASSERT_EQ(3u, spectrum.peak_num);
+            EXPECT_EQ(mz[1], spectrum.mz[1]);
+        }
+    }
+#ifdef PPDATA_WITH_ZLIB
+    EXPECT_EQ(51u, total);
+#else
+    EXPECT_EQ(50u, total);
+#endif
+}
+
+// counts spectrum peaks within 0.02 of a singly charged b/y ion
+struct CountingScorer {
+    struct Context {
+        std::vector<double> peaks;
+        std::vector<double> ions;
+        std::vector<double> prefix;
+    };
+    FragmentGenerator generator;
+
+    void Prepare(const Spectrum& spectrum, Context& context) const {
+        context.peaks.assign(spectrum.mz, spectrum.mz + spectrum.peak_num);
+        std::sort(context.peaks.begin(), context.peaks.end());
+    }
+    double Score(const PPData::Peptide& peptide, Context& context) const {
+        generator.Generate(peptide, context.ions, context.prefix);
+        double count = 0;
+        for (auto ion : context.ions) {
+            auto it = std::lower_bound(context.peaks.begin(), context.peaks.end(), ion - 0.02);
+            if (it != context.peaks.end() && *it <= ion + 0.02) { ++count; }
+        }
+        return count;
+    }
+};
+
+TEST(Unittest_PPData, TopNAndScoreHistogram) {
+    std::mt19937 engine(43);
+    std::uniform_real_distribution<double> score_dist(0, 100);
+    TopN top;
+    std::vector<PSM> result;
+    for (size_t capacity : { 0, 1, 5, 50 }) {  // storage is reused across resets
+        top.Reset(capacity);
+        std::vector<double> scores;
+        for (size_t i = 0; i < 40; ++i) {
+            scores.push_back(score_dist(engine));
+            top.Push(i, scores.back());
+        }
+        std::sort(scores.rbegin(), scores.rend());
+        scores.resize(std::min(capacity, scores.size()));
+        top.Extract(result);
+        ASSERT_EQ(scores.size(), result.size());
+        for (size_t i = 0; i < scores.size(); ++i) { EXPECT_EQ(scores[i], result[i].score); }
+        EXPECT_EQ(0u, top.size());
+    }
+
+    // exponential tail, the number of scores above s is about 10^(4 - s / 5)
+    ScoreHistogram histogram(0.5);
+    std::exponential_distribution<double> tail_dist(std::log(10.0) / 5);
+    for (size_t i = 0; i < 10000; ++i) { histogram.Add(tail_dist(engine)); }
+    EXPECT_EQ(10000u, histogram.total());
+    for (double score : { 5.0, 10.0, 15.0 }) {
+        auto expected = std::pow(10.0, 4 - score / 5);
+        EXPECT_GT(histogram.EValue(score), expected / 2);
+        EXPECT_LT(histogram.EValue(score), expected * 2);
+    }
+    EXPECT_LT(histogram.EValue(30), 1e-1);
+
+    // too few scores, empirical count
+    histogram.Clear();
+    histogram.Add(3);
+    histogram.Add(7);
+    EXPECT_EQ(1, histogram.EValue(7));
+    EXPECT_EQ(2, histogram.EValue(1));
+}
+
+// batch of spectra made of the b/y ladders of every step-th peptide
+static void SyntheticSpectra(const PPData& ppdata, size_t step, SpectrumBatch& batch, std::vector<size_t>& sources) {
+    FragmentGenerator generator;
+    std::vector<double> ions;
+    std::vector<double> prefix;
+    batch.Clear();
+    sources.clear();
+    for (size_t i = 0; i < ppdata.size(); i += step) {
+        auto& peptide = ppdata[i];
+        generator.Generate(peptide, ions, prefix);
+        batch.AddSpectrum(nullptr, 0, peptide.mass / 2 + MassTable::Proton(), 2);
+        for (auto ion : ions) { batch.AddPeak(ion, 100); }
+        sources.push_back(i);
+    }
+    batch.Finish();
+}
+
+TEST(Unittest_PPData, SearchDriver) {
+    TempFile search_fasta("search.fasta");
+    SyntheticProteome(300, 31).Write(search_fasta);
+    PPData ppdata(search_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    SpectrumBatch batch;
+    std::vector<size_t> sources;
+    SyntheticSpectra(ppdata, 97, batch, sources);
+
+    CountingScorer scorer;
+    std::vector<std::vector<PSM>> serial;
+    std::vector<std::vector<PSM>> parallel;
+    auto serial_report = SearchDriver<CountingScorer>(ppdata, scorer, 10, 5, 1).Search(batch, serial);
+    auto parallel_report = SearchDriver<CountingScorer>(ppdata, scorer, 10, 5, 4).Search(batch, parallel);
+    EXPECT_EQ(batch.size(), parallel_report.spectrum_num);
+    EXPECT_EQ(serial_report.candidate_num, parallel_report.candidate_num);
+    EXPECT_GT(parallel_report.spectra_per_second(), 0);
+    // own tasks come by increasing mass, only a stolen one can send a cursor backwards
+    EXPECT_EQ(0u, serial_report.cursor_restart_num);
+    EXPECT_LE(parallel_report.cursor_restart_num, parallel_report.steal_num);
+
+    ASSERT_EQ(batch.size(), parallel.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ASSERT_FALSE(parallel[i].empty());
+        EXPECT_LE(parallel[i].size(), 5u);
+        for (size_t j = 1; j < parallel[i].size(); ++j) {
+            EXPECT_GE(parallel[i][j - 1].score, parallel[i][j].score);
+            EXPECT_LE(parallel[i][j - 1].e_value, parallel[i][j].e_value);
+        }
+        EXPECT_GT(parallel[i].front().e_value, 0);
+        ASSERT_EQ(serial[i].size(), parallel[i].size());
+        for (size_t j = 0; j < parallel[i].size(); ++j) { EXPECT_EQ(serial[i][j].score, parallel[i][j].score); }
+        // the source peptide explains every peak
+        EXPECT_EQ(2.0 * (ppdata[sources[i]].sequence_length - 1), parallel[i].front().score);
+    }
+}
+
+TEST(Unittest_PPData, HyperScorer) {
+    TempFile hyper_fasta("hyper.fasta");
+    const char sequence[] = "PEPTLDEK";
+    PPData::Protein protein("hyper", sequence, 8);
+    PPData::Peptide peptide(protein, sequence, 0, 8, 0);
+    FragmentGenerator generator;
+    std::vector<double> ions;
+    std::vector<double> prefix;
+    generator.Generate(peptide, ions, prefix);  // b1..b7, y1..y7
+
+    // b ions only, all of the same intensity, normalized to 100
+    SpectrumBatch batch;
+    batch.AddSpectrum(nullptr, 0, 500, 2);
+    for (size_t i = 0; i < 7; ++i) { batch.AddPeak(ions[i], 4); }
+    batch.AddPeak(ions[7], 1);  // y1, least intense
+    batch.Finish();
+
+    HyperScorer::Context context;
+    HyperScorer top7(0.02, 7);
+    top7.Prepare(batch[0], context);
+    EXPECT_NEAR(std::log10(700.0 * 5040), top7.Score(peptide, context), 1e-4);
+
+    HyperScorer top8(0.02, 8);
+    top8.Prepare(batch[0], context);
+    EXPECT_NEAR(std::log10(750.0 * 5040), top8.Score(peptide, context), 1e-4);
+
+    // peaks about half a bin off their ions match within the fragment tolerance, on either
+    // side of a bin edge, exact bins miss some of them
+    HyperScorer exact(0.02, 8, 5000.0, 0);
+    for (double offset : { 0.011, -0.011, 0.019 }) {
+        batch.Clear();
+        batch.AddSpectrum(nullptr, 0, 500, 2);
+        for (size_t i = 0; i < 7; ++i) { batch.AddPeak(ions[i] + offset, 4); }
+        batch.AddPeak(ions[7] + offset, 1);
+        batch.Finish();
+        top8.Prepare(batch[0], context);
+        auto tolerant_score = top8.Score(peptide, context);
+        EXPECT_NEAR(std::log10(750.0 * 5040), tolerant_score, 1e-4);
+        exact.Prepare(batch[0], context);
+        EXPECT_LT(exact.Score(peptide, context), tolerant_score - 1);
+    }
+
+    // context is cleared between spectra
+    batch.Clear();
+    batch.AddSpectrum(nullptr, 0, 500, 2);
+    batch.AddPeak(4999, 1);
+    batch.Finish();
+    top8.Prepare(batch[0], context);
+    EXPECT_EQ(0, top8.Score(peptide, context));
+
+    // the source peptide scores best on its own spectrum
+    SyntheticProteome(200, 37).Write(hyper_fasta);
+    PPData ppdata(hyper_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    std::vector<size_t> sources;
+    SyntheticSpectra(ppdata, 211, batch, sources);
+    HyperScorer scorer;
+    std::vector<std::vector<PSM>> results;
+    SearchDriver<HyperScorer>(ppdata, scorer, 3, 3, 2).Search(batch, results);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ASSERT_FALSE(results[i].empty());
+        scorer.Prepare(batch[i], context);
+        EXPECT_EQ(scorer.Score(ppdata[sources[i]], context), results[i].front().score);
+        EXPECT_GT(results[i].front().score, 0);
+    }
+}
+
+TEST(Unittest_PPData, XcorrScorer) {
+    TempFile xcorr_fasta("xcorr.fasta");
+    const char sequence[] = "PEPTLDEWK";
+    PPData::Protein protein("xcorr", sequence, 9);
+    PPData::Peptide peptide(protein, sequence, 0, 9, 0);
+    FragmentGenerator generator;
+    std::vector<double> ions;
+    std::vector<double> prefix;
+    generator.Generate(peptide, ions, prefix);
+
+    // equal peaks on every ion, each normalized to 50 and reduced by the mean of its neighbours
+    SpectrumBatch batch;
+    batch.AddSpectrum(nullptr, 0, 500, 2);
+    for (auto ion : ions) { batch.AddPeak(ion, 9); }
+    batch.Finish();
+    XcorrScorer scorer;
+    std::set<size_t> bins;
+    for (auto ion : ions) { bins.insert(scorer.Bin(ion)); }
+    ASSERT_EQ(ions.size(), bins.size());
+    double expected = 0;
+    for (auto bin : bins) {
+        double neighbours = 0;
+        for (auto other : bins) { neighbours += other != bin && other + 75 >= bin && other <= bin + 75; }
+        expected += 0.005 * (50 - 50 * neighbours / 150);
+    }
+    XcorrScorer::Context context;
+    scorer.Prepare(batch[0], context);
+    EXPECT_NEAR(expected, scorer.Score(peptide, context), 1e-4);
+
+    // the source peptide scores best on its own spectrum
+    SyntheticProteome(200, 41).Write(xcorr_fasta);
+    PPData ppdata(xcorr_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    std::vector<size_t> sources;
+    SyntheticSpectra(ppdata, 211, batch, sources);
+    std::vector<std::vector<PSM>> results;
+    SearchDriver<XcorrScorer>(ppdata, scorer, 3, 3, 2).Search(batch, results);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ASSERT_FALSE(results[i].empty());
+        scorer.Prepare(batch[i], context);
+        EXPECT_EQ(scorer.Score(ppdata[sources[i]], context), results[i].front().score);
+        EXPECT_GT(results[i].front().score, 0);
+    }
+}
+
+TEST(Unittest_PPData, OpenSearch) {
+    TempFile open_fasta("open.fasta");
+    SyntheticProteome(150, 47).Write(open_fasta);
+    PPData ppdata(open_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+
+    // increasing queries with jumps and a step backwards, same windows as binary search
+    MassCursor cursor(ppdata);
+    for (double mass : { 500.0, 700.0, 700.0, 700.5, 1200.0, 3000.0, 900.0, 901.0, 6000.0 }) {
+        auto span = cursor.Advance(mass - 150, mass + 500);
+        EXPECT_EQ(ppdata.lower_bound(mass - 150), span.first);
+        EXPECT_EQ(std::max(span.first, ppdata.upper_bound(mass + 500)), span.last);
+    }
+    EXPECT_EQ(1u, cursor.restart_num());  // only the step backwards
+
+    // phosphorylated precursors with unmodified fragments
+    SpectrumBatch batch;
+    std::vector<size_t> sources;
+    SyntheticSpectra(ppdata, 307, batch, sources);
+    SpectrumBatch shifted;
+    for (auto& spectrum : batch) {
+        shifted.AddSpectrum(nullptr, 0, spectrum.precursor_mz + 79.966331 / 2, 2);
+        for (size_t i = 0; i < spectrum.peak_num; ++i) { shifted.AddPeak(spectrum.mz[i], spectrum.intensity[i]); }
+    }
+    shifted.Finish();
+
+    CountingScorer scorer;
+    MassShiftHistogram shifts(-150, 500);
+    std::vector<std::vector<PSM>> results;
+    auto report = SearchDriver<CountingScorer>(ppdata, scorer, std::make_pair(-150.0, 500.0), 1, 2)
+                      .Search(shifted, results, &shifts);
+    EXPECT_GT(report.candidate_num, 100 * shifted.size());
+    for (size_t i = 0; i < shifted.size(); ++i) {
+        ASSERT_EQ(1u, results[i].size());
+        EXPECT_EQ(2.0 * (ppdata[sources[i]].sequence_length - 1), results[i].front().score);
+    }
+    EXPECT_EQ(shifted.size(), shifts.total());
+    auto peaks = shifts.Peaks(2);
+    ASSERT_FALSE(peaks.empty());
+    EXPECT_NEAR(79.966331, peaks.front().shift, 1e-3);
+    EXPECT_EQ(shifted.size(), peaks.front().count);
+}
+
+TEST(Unittest_PPData, PrecursorQuery) {
+    TempFile precursor_fasta("precursor.fasta");
+    SyntheticProteome(300, 53).Write(precursor_fasta);
+    PPData ppdata(precursor_fasta, true, PPData::EnzymeType::Trypsin, 2, 600, 5000);
+    const std::vector<unsigned> charges = { 2, 3, 4 };
+    const std::vector<int> isotopes = { -1, 0, 1, 2, 3 };
+    std::vector<PrecursorQuery::Range> ranges;
+
+    for (bool ppm : { false, true }) {
+        // wide enough for neighbouring isotope windows to overlap
+        PrecursorQuery query(charges, isotopes, ppm ? 600 : 0.6, ppm);
+        EXPECT_EQ(15u, query.window_num());
+        for (double mz : { 450.27, 612.8, 733.41, 1001.5 }) {
+            query.Query(ppdata, mz, ranges);
+            std::vector<uint32_t> masks(ppdata.size(), 0);
+            for (size_t i = 0; i < ppdata.size(); ++i) {
+                for (size_t c = 0; c < charges.size(); ++c) {
+                    for (size_t k = 0; k < isotopes.size(); ++k) {
+                        auto center = (mz - MassTable::Proton()) * charges[c] - isotopes[k] * PrecursorQuery::IsotopeSpacing();
+                        auto width = ppm ? center * 600e-6 : 0.6;
+                        if (std::abs(ppdata[i].mass - center) <= width) { masks[i] |= 1u << (c * isotopes.size() + k); }
+                    }
+                }
+            }
+            // ranges are disjoint, increasing, and tag every matching peptide exactly once
+            std::vector<uint32_t> found(ppdata.size(), 0);
+            for (size_t r = 0; r < ranges.size(); ++r) {
+                auto& range = ranges[r];
+                ASSERT_LT(range.first, range.last);
+                if (r > 0) { EXPECT_LE(ranges[r - 1].last, range.first); }
+                for (auto i = range.first; i < range.last; ++i) { found[i] = range.windows; }
+                unsigned lowest = 0;
+                while (!(range.windows >> lowest & 1u)) { ++lowest; }
+                EXPECT_EQ(charges[lowest / isotopes.size()], range.charge);
+                EXPECT_EQ(isotopes[lowest % isotopes.size()], range.isotope);
+            }
+            for (size_t i = 0; i < ppdata.size(); ++i) { EXPECT_EQ(masks[i], found[i]); }
+        }
+    }
+
+    // no peptide, no range
+    std::ofstream(precursor_fasta) << ">sp|SHORT|SHORT\nMKR\n";
+    PPData empty(precursor_fasta, false, PPData::EnzymeType::Trypsin, 0, 600, 5000);
+    ASSERT_EQ(0u, empty.size());
+    PrecursorQuery(charges, isotopes, 0.6).Query(empty, 612.8, ranges);
+    EXPECT_TRUE(ranges.empty());
+}
+
+TEST(Unittest_PPData, SyntheticProteome) {
+    TempFile synthetic_fasta("synthetic.fasta");
+    SyntheticProteome proteome(2000, 7);
+    ASSERT_EQ(2000u, proteome.size());
+
+    // same parameters, same database
+    std::ostringstream one;
+    std::ostringstream another;
+    proteome.Write(one);
+    SyntheticProteome(2000, 7).Write(another);
+    EXPECT_EQ(one.str(), another.str());
+    std::ostringstream other_seed;
+    SyntheticProteome(2000, 8).Write(other_seed);
+    EXPECT_NE(one.str(), other_seed.str());
+
+    // realistic lengths and composition
+    std::vector<size_t> lengths;
+    std::map<char, size_t> counts;
+    for (size_t i = 0; i < proteome.size(); ++i) {
+        auto& sequence = proteome.sequence(i);
+        lengths.push_back(sequence.size());
+        EXPECT_GE(sequence.size(), 30u);
+        EXPECT_LE(sequence.size(), 5000u);
+        EXPECT_EQ('M', sequence[0]);
+        for (auto c : sequence) { ++counts[c]; }
+    }
+    std::sort(lengths.begin(), lengths.end());
+    EXPECT_NEAR(300.0, lengths[lengths.size() / 2], 30.0);
+    EXPECT_EQ(20u, counts.size());
+    auto residues = static_cast<double>(proteome.residue_num());
+    EXPECT_NEAR(0.0966, counts['L'] / residues, 0.005);
+    EXPECT_NEAR(0.0108, counts['W'] / residues, 0.002);
+
+    // isoforms share peptides, so the database is smaller after dedup
+    proteome.Write(synthetic_fasta);
+    PPData ppdata(synthetic_fasta, false, PPData::EnzymeType::Trypsin, 0, 600, 5000);
+    ProtData proteins(synthetic_fasta, false);
+    Digester digester(PPData::EnzymeType::Trypsin, 0, 600, 5000);
+    size_t digest_num = 0;
+    for (auto& protein : proteins) {
+        std::string compact(protein.sequence, protein.sequence_length);
+        for (auto& c : compact) { c = Digester::Normalize(c); }
+        digester.Digest(compact.c_str(), compact.size(), [&](size_t, size_t, double) { ++digest_num; });
+    }
+    EXPECT_LT(ppdata.size(), digest_num * 95 / 100);
+}
+
+TEST(Unittest_PPData, BuildReport) {
+    TempFile report_fasta("report.fasta");
+    SyntheticProteome(1000, 3).Write(report_fasta);
+    PPData ppdata(report_fasta, true, PPData::EnzymeType::Trypsin, 1, 600, 5000);
+    auto& report = ppdata.build_report();
+
+    std::vector<std::string> names;
+    for (auto& stage : report.stages) {
+        names.push_back(stage.name);
+        EXPECT_GE(stage.wall_seconds, 0.0);
+        EXPECT_GE(stage.start_seconds, 0.0);
+    }
+    EXPECT_EQ(std::vector<std::string>({ "ReadFile", "CompactFasta", "ParseProteins", "BuildDecoys",
+                                         "BuildCompactSequences", "Digest", "Dedup", "Sort" }), names);
+    EXPECT_EQ(nullptr, report.stage("LoadTable"));
+
+    // counts chain from stage to stage
+    auto targets = report.stage("ParseProteins")->items_out;
+    EXPECT_EQ(1000u, targets);
+    EXPECT_EQ(targets, report.stage("BuildDecoys")->items_out);
+    EXPECT_EQ(2 * targets, report.stage("BuildCompactSequences")->items_in);
+    auto digest = report.stage("Digest");
+    auto dedup = report.stage("Dedup");
+    EXPECT_GT(digest->items_in, digest->items_out);  // mass filtering
+    EXPECT_EQ(digest->items_out, dedup->items_in);
+    EXPECT_GT(dedup->items_in, dedup->items_out);  // isoforms
+    EXPECT_EQ(ppdata.size(), dedup->items_out);
+    EXPECT_EQ(ppdata.size(), report.stage("Sort")->items_out);
+    EXPECT_GE(report.stage("Sort")->buffer_bytes, ppdata.size() * sizeof(PPData::Peptide));
+    EXPECT_LT(dedup->allocations * 100, dedup->items_out);  // the flat PeptideSet is sized up front
+    EXPECT_GT(report.stage("ReadFile")->bytes_allocated, report.stage("ReadFile")->items_out);
+
+    std::ostringstream json;
+    report.WriteJson(json);
+    EXPECT_NE(std::string::npos, json.str().find("\"name\": \"Dedup\""));
+    std::ostringstream trace;
+    report.WriteChromeTrace(trace);
+    EXPECT_EQ(0u, trace.str().find("{\"traceEvents\": ["));
+    EXPECT_NE(std::string::npos, trace.str().find("\"ph\": \"X\""));
+
+    // copies keep the report
+    PPData copy(ppdata);
+    EXPECT_EQ(report.stages.size(), copy.build_report().stages.size());
+}
+
+TEST(Unittest_PPData, PeptideSet) {
+    // many short sequences with duplicates, against std::unordered_set
+    std::string sequence;
+    std::mt19937 engine(11);
+    std::uniform_int_distribution<int> residue_dist(0, 3);
+    for (size_t i = 0; i < 60000; ++i) { sequence.push_back("ACDE"[residue_dist(engine)]); }
+    PPData::Protein protein("test", sequence.c_str(), sequence.size());
+    std::uniform_int_distribution<size_t> length_dist(1, 12);
+
+    PeptideSet set;  // starts at one group, grows many times
+    std::unordered_set<PPData::Peptide> reference;
+    std::vector<PPData::Peptide> first_seen;
+    for (size_t start = 0; start + 12 < sequence.size(); start += 3) {
+        PPData::Peptide peptide(protein, sequence.c_str(), start, start + length_dist(engine), static_cast<double>(start));
+        auto inserted = set.Insert(peptide);
+        EXPECT_EQ(reference.insert(peptide).second, inserted);
+        if (inserted) { first_seen.push_back(peptide); }
+    }
+    ASSERT_EQ(reference.size(), set.size());
+    ASSERT_GT(sequence.size() / 3, set.size());  // duplicates were found
+
+    // insertion order, first of equal peptides kept
+    for (uint32_t id = 0; id < set.size(); ++id) {
+        EXPECT_EQ(first_seen[id].offset, set[id].offset);
+        EXPECT_EQ(first_seen[id].mass, set[id].mass);
+    }
+    auto peptides = set.Release();
+    EXPECT_EQ(first_seen.size(), peptides.size());
+    EXPECT_EQ(0u, set.size());
+    EXPECT_TRUE(set.Insert(peptides.front()));
+
+    // sized up front, no growth
+    PeptideSet sized(1000);
+    auto bytes = sized.memory_bytes();
+    for (size_t i = 0; i < 1000; ++i) { sized.Insert(peptides[i]); }
+    EXPECT_EQ(bytes, sized.memory_bytes());
+}
+
+TEST(Unittest_PPData, ParallelBuild) {
+    TempFile parallel_fasta("parallel.fasta");
+    SyntheticProteome(3000, 5).Write(parallel_fasta);
+    PPData::Options options;
+    options.append_decoy = true;
+    options.max_miss_cleavage = 2;
+    options.thread_num = 1;
+    PPData serial(parallel_fasta, options);
+    for (unsigned thread_num : { 2u, 3u, 8u }) {
+        options.thread_num = thread_num;
+        PPData parallel(parallel_fasta, options);
+        ASSERT_EQ(serial.size(), parallel.size());
+        size_t mismatch = 0;
+        for (size_t i = 0; i < serial.size(); ++i) {
+            auto& one = serial[i];
+            auto& another = parallel[i];
+            mismatch += one.mass != another.mass || one.offset != another.offset
+                        || std::strcmp(one.protein->name, another.protein->name) != 0
+                        || std::string(one.sequence, one.sequence_length) != std::string(another.sequence, another.sequence_length);
+        }
+        EXPECT_EQ(0u, mismatch) << thread_num << " threads";
+    }
+
+    // the earliest protein and offset are kept, whatever order the threads insert in
+    std::string sequence = "PEPTLDEKPEPTLDEKPEPTLDEK";
+    std::vector<PPData::Protein> proteins(4, PPData::Protein("test", sequence.c_str(), sequence.size()));
+    ConcurrentPeptideSet pool(0, 4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (auto p = proteins.size(); p-- > 0;) {
+                for (int offset = 16; offset >= 0; offset -= 8) {
+                    pool.Insert(PPData::Peptide(proteins[(p + t) % proteins.size()], sequence.c_str(),
+                                                static_cast<size_t>(offset), static_cast<size_t>(offset) + 8, 0));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    auto peptides = pool.Release();
+    ASSERT_EQ(1u, peptides.size());
+    EXPECT_EQ(&proteins[0], peptides[0].protein);
+    EXPECT_EQ(0u, peptides[0].offset);
+}
+
+TEST(Unittest_PPData, PackedSequences) {
+    TempFile packed_fasta("packed.fasta");
+    // round trip, I comes back as L, other characters as '?'
+    PackedSequences packed;
+    std::vector<std::string> sequences = { "MPEPTIDEKLLR", "", "ACDEFGHIKLMNPQRSTVWYBXZUO*", std::string(100, 'K') + "ILIL" };
+    for (auto& sequence : sequences) { packed.Add(sequence.c_str(), sequence.size()); }
+    ASSERT_EQ(sequences.size(), packed.size());
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        std::string expected = sequences[i];
+        for (auto& c : expected) { c = c == 'I' ? 'L' : (c >= 'A' && c <= 'Z' ? c : '?'); }
+        std::string unpacked(sequences[i].size(), ' ');
+        packed.Unpack(i, 0, unpacked.size(), &unpacked[0]);
+        EXPECT_EQ(expected, unpacked);
+    }
+
+    // hash and equality of substrings agree with the normalized bytes, every protein is
+    // also added shifted by a few residues, so equal substrings sit at other word offsets
+    auto proteome = SyntheticProteome(50, 9);
+    PackedSequences proteins;
+    std::vector<std::string> normalized;
+    for (size_t i = 0; i < proteome.size(); ++i) {
+        auto shifted = std::string(i % 11 + 1, 'G') + proteome.sequence(i);
+        for (auto& sequence : { proteome.sequence(i), shifted }) {
+            proteins.Add(sequence.c_str(), sequence.size());
+            normalized.push_back(sequence);
+            for (auto& c : normalized.back()) { c = Digester::Normalize(c); }
+        }
+    }
+    // the hash of one window at a time, as without SSE2
+    auto window_hash = [&proteins](size_t index, size_t offset, size_t length) {
+        uint64_t hash = 0x9e3779b97f4a7c15ull ^ length;
+        size_t i = 0;
+        for (; i + 12 <= length; i += 12) {
+            hash = (hash ^ proteins.Window(index, offset + i)) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 32;
+        }
+        if (i < length) {
+            auto tail = proteins.Window(index, offset + i) & ((uint64_t(1) << ((length - i) * 5)) - 1);
+            hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+        }
+        return hash ^ (hash >> 29);
+    };
+    std::mt19937 engine(4);
+    size_t equal_num = 0;
+    for (size_t k = 0; k < 20000; ++k) {
+        auto i = engine() % proteome.size() * 2;
+        auto length = 1 + engine() % 30;
+        auto one = engine() % (normalized[i].size() - length);
+        auto j = k % 2 == 0 ? i + 1 : engine() % normalized.size();
+        auto another = k % 2 == 0 ? one + i / 2 % 11 + 1 : engine() % (normalized[j].size() - length);
+        auto equal = normalized[i].compare(one, length, normalized[j], another, length) == 0;
+        equal_num += equal;
+        EXPECT_EQ(equal, proteins.Equal(i, one, j, another, length));
+        if (equal) { EXPECT_EQ(proteins.Hash(i, one, length), proteins.Hash(j, another, length)); }
+        EXPECT_EQ(window_hash(i, one, length), proteins.Hash(i, one, length));
+    }
+    EXPECT_GT(equal_num, 9000u);
+
+    // the packed build keeps the same peptides, deduplicated on packed words
+    proteome.Write(packed_fasta);
+    PPData::Options options;
+    options.append_decoy = true;
+    options.max_miss_cleavage = 2;
+    options.thread_num = 1;
+    PPData plain(packed_fasta, options);
+    EXPECT_EQ(nullptr, plain.packed_sequences());
+    FragmentGenerator generator(FragmentGenerator::kB | FragmentGenerator::kY, 2);
+    std::vector<double> ions(1000), packed_ions(1000), prefix(100);
+    for (auto thread_num : { 1u, 3u }) {
+        options.pack_sequences = true;
+        options.thread_num = thread_num;
+        PPData compact(packed_fasta, options);
+        ASSERT_NE(nullptr, compact.packed_sequences());
+        ASSERT_EQ(plain.size(), compact.size());
+        size_t mismatch = 0, as_read = 0;
+        std::hash<PPData::Peptide> hash;
+        for (size_t i = 0; i < plain.size(); ++i) {
+            auto& one = plain[i];
+            auto& another = compact[i];
+            std::string sequence(another.sequence, another.sequence_length);
+            for (auto& c : sequence) { c = Digester::Normalize(c); }
+            as_read += std::strncmp(another.sequence, sequence.c_str(), sequence.size()) != 0;
+            mismatch += one.mass != another.mass || one.offset != another.offset
+                        || std::strcmp(one.protein->name, another.protein->name) != 0
+                        || std::string(one.sequence, one.sequence_length) != sequence
+                        || !(one == another) || hash(one) != hash(another);  // I and L alike
+        }
+        EXPECT_EQ(0u, mismatch);
+        EXPECT_LT(0u, as_read);  // some peptides point at an I
+    }
+    EXPECT_TRUE(EqualSequences("PEPTIDEKIL", "PEPTLDEKLI", 10));  // across the word boundary
+    EXPECT_FALSE(EqualSequences("PEPTIDEKIL", "PEPTIDEKIM", 10));
+    EXPECT_FALSE(EqualSequences("\xc9J", "LJ", 2));  // only I itself, not I with the high bit
+    EXPECT_EQ(HashSequence("KIIIIIIIIR", 10), HashSequence("KLLLLLLLLR", 10));
+
+    // fragments straight from the packed words
+    options.thread_num = 1;
+    PPData compact(packed_fasta, options);
+    ProtData prot_data(packed_fasta, true);
+    auto& packed_proteins = *compact.packed_sequences();
+    for (size_t i = 0; i < compact.size(); i += 97) {
+        auto& peptide = compact[i];
+        auto index = static_cast<size_t>(std::find_if(prot_data.begin(), prot_data.end(), [&](const PPData::Protein& protein) {
+            return std::strcmp(protein.name, peptide.protein->name) == 0;
+        }) - prot_data.begin());
+        auto num = generator.Generate(peptide, ions.data(), prefix.data());
+        ASSERT_EQ(num, generator.Generate(packed_proteins, index, peptide.offset, peptide.sequence_length,
+                                          packed_ions.data(), prefix.data()));
+        for (size_t k = 0; k < num; ++k) { ASSERT_DOUBLE_EQ(ions[k], packed_ions[k]); }
+    }
+}
+
+TEST(Unittest_PPData, NormalizeInPlace) {
+    TempFile normalize_fasta("normalize.fasta");
+    // I next to K or R keeps its original residue for flanks, also mirrored in the decoy
+    std::ofstream(normalize_fasta) << ">sp|IL1|IL1\nMLIKIDEAGLEPTLDEKAGLWR\n>sp|IL2|IL2\nIRIGGIGK\nIDR\n";
+    ProtData normalized(normalize_fasta, true, nullptr, true);
+    ASSERT_EQ(4u, normalized.size());
+    EXPECT_STREQ("MLLKLDEAGLEPTLDEKAGLWR", normalized[0].sequence);
+    EXPECT_STREQ("RWLGAKEDLTPELGAEDLKLLM", normalized[2].sequence);
+    std::string original, decoy;
+    for (size_t i = 0; i < normalized[0].sequence_length; ++i) { original += normalized.OriginalResidue(normalized[0], i); }
+    for (size_t i = 0; i < normalized[2].sequence_length; ++i) { decoy += normalized.OriginalResidue(normalized[2], i); }
+    EXPECT_EQ("MLIKIDEAGLEPTLDEKAGLWR", original);  // I at 1 has no such neighbour, not kept
+    EXPECT_EQ("RWLGAKEDLTPELGAEDIKILM", decoy);
+    EXPECT_EQ('I', normalized.OriginalResidue(normalized[1], 0));
+    EXPECT_EQ('I', normalized.OriginalResidue(normalized[1], 2));
+    EXPECT_EQ('L', normalized.OriginalResidue(normalized[1], 5));
+    EXPECT_EQ('I', normalized.OriginalResidue(normalized[1], 8));  // across a line break
+
+    // the same peptides as the normalized copy, flanks included, with no copy made
+    SyntheticProteome(1000, 12).Write(normalize_fasta);
+    PPData::Options options;
+    options.append_decoy = true;
+    options.max_miss_cleavage = 2;
+    options.thread_num = 1;
+    PPData copied(normalize_fasta, options);
+    options.normalize_in_place = true;
+    for (auto thread_num : { 1u, 3u }) {
+        for (auto pack : { false, true }) {
+            options.thread_num = thread_num;
+            options.pack_sequences = pack;
+            PPData shared(normalize_fasta, options);
+            EXPECT_EQ(nullptr, shared.build_report().stage("BuildCompactSequences"));
+            ASSERT_EQ(copied.size(), shared.size());
+            size_t mismatch = 0, flanking_isoleucine = 0;
+            for (size_t i = 0; i < copied.size(); ++i) {
+                auto& one = copied[i];
+                auto& another = shared[i];
+                mismatch += one.mass != another.mass || one.offset != another.offset
+                            || one.n_term != another.n_term || one.c_term != another.c_term
+                            || std::strcmp(one.protein->name, another.protein->name) != 0
+                            || std::string(one.sequence, one.sequence_length)
+                               != std::string(another.sequence, another.sequence_length);
+                flanking_isoleucine += another.c_term == 'I';
+            }
+            EXPECT_EQ(0u, mismatch);
+            EXPECT_GT(flanking_isoleucine, 0u);
+        }
+    }
+}
+
+TEST(Unittest_PPData, LengthAndFilter) {
+    TempFile filter_fasta("filter.fasta");
+    // filtering in the digestion keeps exactly the peptides a filter after the build keeps
+    SyntheticProteome(1000, 13).Write(filter_fasta);
+    PPData::Options options;
+    options.append_decoy = true;
+    options.max_miss_cleavage = 2;
+    options.thread_num = 1;
+    PPData all(filter_fasta, options);
+    auto keep = [](const char* sequence, size_t length, double mass) {
+        return sequence[length - 1] != 'R' || mass < 2000.0;
+    };
+    std::vector<PeptideKey> expected;
+    for (size_t i = 0; i < all.size(); ++i) {
+        auto& peptide = all[i];
+        if (peptide.sequence_length < 7 || peptide.sequence_length > 20
+                || !keep(peptide.sequence, peptide.sequence_length, peptide.mass)) { continue; }
+        expected.push_back(PeptideKey(std::string(peptide.sequence, peptide.sequence_length), peptide.mass,
+                                      std::string(peptide.protein->name), peptide.offset));
+    }
+
+    // the filter sees I/L-normalized sequences, also when peptides point to the sequences as read
+    std::atomic<size_t> isoleucine_num(0);
+    options.min_length = 7;
+    options.max_length = 20;
+    options.filter = [&](const char* sequence, size_t length, double mass) {
+        isoleucine_num += static_cast<size_t>(std::count(sequence, sequence + length, 'I'));
+        return keep(sequence, length, mass);
+    };
+    for (auto thread_num : { 1u, 3u }) {
+        for (auto pack : { false, true }) {
+            options.thread_num = thread_num;
+            options.pack_sequences = pack;
+            PPData filtered(filter_fasta, options);
+            std::vector<PeptideKey> actual;
+            for (size_t i = 0; i < filtered.size(); ++i) {
+                auto& peptide = filtered[i];
+                std::string sequence(peptide.sequence, peptide.sequence_length);
+                std::replace(sequence.begin(), sequence.end(), 'I', 'L');
+                actual.push_back(PeptideKey(sequence, peptide.mass, std::string(peptide.protein->name), peptide.offset));
+            }
+            EXPECT_EQ(expected, actual);
+            auto digest = filtered.build_report().stage("Digest");
+            EXPECT_LT(digest->items_out, all.build_report().stage("Digest")->items_out);
+            EXPECT_EQ(filtered.build_report().stage("Dedup")->items_in, digest->items_out);
+        }
+    }
+    EXPECT_EQ(0u, isoleucine_num.load());
+}
+
+using Digest = std::tuple<size_t, size_t, double>;
+
+// every peptide of at most max_miss_cleavage missed cleavages after the residues of
+// cleaves_after (not before P), the mass of each summed afresh from its segments
+static std::vector<Digest> ReferenceDigest(const std::string& sequence, unsigned max_miss_cleavage,
+                                           double min_mass, double max_mass, const std::string& cleaves_after = "KR") {
+    std::vector<size_t> sites = { 0 };
+    for (size_t i = 1; i < sequence.size(); ++i) {
+        if (cleaves_after.find(sequence[i - 1]) != std::string::npos && sequence[i] != 'P') { sites.push_back(i); }
+    }
+    sites.push_back(sequence.size());
+    std::vector<double> segments;
+    for (size_t i = 0; i + 1 < sites.size(); ++i) {
+        double segment = 0;
+        for (auto j = sites[i]; j < sites[i + 1]; ++j) {
+            auto residue_mass = MassTable::Default()[sequence[j]];
+            if (residue_mass == 0) {
+                segment = 0;
+                break;
+            }
+            segment += residue_mass;
+        }
+        segments.push_back(segment);
+    }
+    std::vector<Digest> digests;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        for (size_t miss = 0; miss <= max_miss_cleavage && i + miss < segments.size(); ++miss) {
+            auto mass = MassTable::Water();
+            auto valid = true;
+            for (auto j = i; j <= i + miss; ++j) {
+                valid = valid && segments[j] != 0;
+                mass += segments[j];
+            }
+            if (valid && min_mass <= mass && mass <= max_mass) { digests.push_back(Digest(sites[i], sites[i + miss + 1], mass)); }
+        }
+    }
+    return digests;
+}
+
+TEST(Unittest_PPData, DigestKernel) {
+    // the incremental kernel against sums from scratch, with unknown residues sprinkled in
+    SyntheticProteome proteome(300, 17);
+    std::mt19937 engine(17);
+    std::vector<std::string> sequences;
+    for (size_t i = 0; i < proteome.size(); ++i) {
+        sequences.push_back(proteome.sequence(i));
+        for (auto& c : sequences.back()) { c = engine() % 200 == 0 ? 'X' : Digester::Normalize(c); }
+    }
+    sequences.push_back("");
+    sequences.push_back("KKKRRRPK");
+    for (unsigned miss = 0; miss <= 5; ++miss) {
+        Digester digester(PPData::EnzymeType::Trypsin, miss, 600, 5000);
+        for (auto& sequence : sequences) {
+            std::vector<Digest> digests;
+            size_t filtered = 0;
+            digester.Digest(sequence.c_str(), sequence.size(), [&](size_t start, size_t end, double mass) {
+                digests.push_back(Digest(start, end, mass));
+            }, &filtered);
+            std::sort(digests.begin(), digests.end());
+            ASSERT_EQ(ReferenceDigest(sequence, miss, 600, 5000), digests) << sequence << " miss " << miss;
+
+            // every candidate, a start and a number of missed cleavages, is kept or filtered
+            if (sequence.empty()) { continue; }
+            size_t segment_num = 1;
+            for (size_t i = 1; i < sequence.size(); ++i) {
+                segment_num += (sequence[i - 1] == 'K' || sequence[i - 1] == 'R') && sequence[i] != 'P';
+            }
+            size_t candidate_num = 0;
+            for (size_t first = 0; first < segment_num; ++first) {
+                candidate_num += std::min<size_t>(segment_num - 1, first + miss) - first + 1;
+            }
+            ASSERT_EQ(candidate_num, digests.size() + filtered) << sequence << " miss " << miss;
+        }
+    }
+}
+
+TEST(Unittest_PPData, MultiEnzyme) {
+    TempFile enzymes_fasta("enzymes.fasta");
+    // the sites of both enzymes in one scan, missed cleavages counted over all of them
+    SyntheticProteome proteome(200, 19);
+    auto trypsin_glu_c = EnzymeMask(PPData::EnzymeType::Trypsin) | EnzymeMask(PPData::EnzymeType::GluC);
+    for (unsigned miss = 0; miss <= 3; ++miss) {
+        Digester digester(trypsin_glu_c, miss, 600, 5000);
+        Digester lys_c(PPData::EnzymeType::LysC, miss, 600, 5000);
+        for (size_t i = 0; i < proteome.size(); ++i) {
+            auto sequence = proteome.sequence(i);
+            for (auto& c : sequence) { c = Digester::Normalize(c); }
+            std::vector<Digest> digests, lys_c_digests;
+            digester.Digest(sequence.c_str(), sequence.size(), [&](size_t start, size_t end, double mass) {
+                digests.push_back(Digest(start, end, mass));
+            });
+            lys_c.Digest(sequence.c_str(), sequence.size(), [&](size_t start, size_t end, double mass) {
+                lys_c_digests.push_back(Digest(start, end, mass));
+            });
+            std::sort(digests.begin(), digests.end());
+            std::sort(lys_c_digests.begin(), lys_c_digests.end());
+            ASSERT_EQ(ReferenceDigest(sequence, miss, 600, 5000, "KRE"), digests);
+            ASSERT_EQ(ReferenceDigest(sequence, miss, 600, 5000, "K"), lys_c_digests);
+        }
+    }
+
+    // one build deduplicates the peptides of the mixture in one pool
+    proteome.Write(enzymes_fasta);
+    PPData::Options options;
+    options.max_miss_cleavage = 1;
+    options.thread_num = 1;
+    PPData trypsin(enzymes_fasta, options);
+    options.additional_enzymes = { PPData::EnzymeType::LysC };
+    PPData with_lys_c(enzymes_fasta, options);
+    EXPECT_EQ(PeptideKeys(trypsin), PeptideKeys(with_lys_c));  // K sites are tryptic already
+    options.additional_enzymes = { PPData::EnzymeType::GluC };
+    for (auto thread_num : { 1u, 3u }) {
+        options.thread_num = thread_num;
+        PPData with_glu_c(enzymes_fasta, options);
+        std::set<std::string> expected, actual;
+        for (size_t i = 0; i < proteome.size(); ++i) {
+            auto sequence = proteome.sequence(i);
+            for (auto& c : sequence) { c = Digester::Normalize(c); }
+            for (auto& digest : ReferenceDigest(sequence, 1, 600, 5000, "KRE")) {
+                expected.insert(sequence.substr(std::get<0>(digest), std::get<1>(digest) - std::get<0>(digest)));
+            }
+        }
+        for (size_t i = 0; i < with_glu_c.size(); ++i) {
+            actual.insert(std::string(with_glu_c[i].sequence, with_glu_c[i].sequence_length));
+        }
+        EXPECT_EQ(expected.size(), with_glu_c.size());  // distinct
+        EXPECT_EQ(expected, actual);
+    }
+
+    // the flank residues of normalize mode follow the rules of all the enzymes
+    std::string cleaves_after;
+    for (int c = 'A'; c <= 'Z'; ++c) {
+        if (Digester::CleavesAfter(static_cast<char>(c))) { cleaves_after += static_cast<char>(c); }
+    }
+    EXPECT_EQ("EKR", cleaves_after);
+}